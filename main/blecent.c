@@ -4,11 +4,21 @@
 #include "esp_log.h"
 #include "host/ble_gap.h"
 #include "host/ble_hs.h"
+#include "mqtt_outbox.h"
 #include "mqtt_section.h"
 #include "nimble/nimble_port.h"
 #include "nimble/nimble_port_freertos.h"
 #include "services/gap/ble_svc_gap.h"
+#include "ssm_boot.h"
 #include "ssm_cmd.h"
+#include "ssm_conn.h"
+#include "ssm_crypto.h"
+#include "ssm_log.h"
+#include "ssm_nvs.h"
+#include "ssm_rssi.h"
+#include "ssm_sup.h"
+#include "ssm_telemetry.h"
+#include "ssm_timer.h"
 static const char * TAG = "blecent.c";
 
 static const ble_uuid_t * ssm_svc_uuid = BLE_UUID16_DECLARE(0xFD81); // https://github.com/CANDY-HOUSE/Sesame_BluetoothAPI_document/blob/master/SesameOS3/1_advertising.md
@@ -18,40 +28,73 @@ static const ble_uuid_t * ssm_ntf_uuid = BLE_UUID128_DECLARE(0x3e, 0x99, 0x76, 0
 static int ble_gap_connect_event(struct ble_gap_event * event, void * arg);
 // static int ble_gap_connect_event_tch(struct ble_gap_event * event, void * arg);
 
-static int ssm_enable_notify(uint16_t conn_handle) {
-	const struct peer_dsc * dsc;
+static void service_disc_complete(const struct peer * peer, int status, void * arg);
+
+static int ssm_enable_notify_cb(uint16_t conn_handle, const struct ble_gatt_error * error, struct ble_gatt_attr * attr, void * arg) {
+	sesame * ssm = (sesame *) arg;
+	ssm_conn_t * c = ssm_conn_get(ssm);
+	if (error->status == 0) {
+		ESP_LOGW(TAG, "Enable notify success!!");
+		ssm_conn_advance(ssm, SSM_CONN_INITIAL);
+		return 0;
+	}
 	const struct peer * peer = peer_find(conn_handle);
-	dsc = peer_dsc_find_uuid(peer, ssm_svc_uuid, ssm_ntf_uuid, BLE_UUID16_DECLARE(BLE_GATT_DSC_CLT_CFG_UUID16));
-	if (dsc == NULL) {
-		ESP_LOGE(TAG, "Error: Peer lacks a CCCD for the Unread Alert Status characteristic\n");
-		goto err;
+	if (c != NULL && peer != NULL && SLIST_EMPTY(&peer->svcs)) { // the cached handle is stale, e.g. after a firmware update
+		ESP_LOGW(TAG, "Cached CCCD handle failed; status=%d, discover services", error->status);
+		c->chr_handle = c->cccd_handle = 0;
+		if (peer_disc_all(conn_handle, service_disc_complete, ssm) == 0) {
+			return 0;
+		}
+	}
+	ESP_LOGE(TAG, "Error: Failed to subscribe to characteristic; status=%d\n", error->status);
+	ble_gap_terminate(conn_handle, BLE_ERR_REM_USER_CONN_TERM); /* Terminate the connection. */
+	return 0;
+}
+
+static int ssm_enable_notify(uint16_t conn_handle, sesame * ssm) {
+	ssm_conn_t * c = ssm_conn_get(ssm);
+	uint16_t cccd_handle = (c != NULL) ? c->cccd_handle : 0;
+	if (cccd_handle == 0) {
+		const struct peer * peer = peer_find(conn_handle);
+		const struct peer_dsc * dsc = peer_dsc_find_uuid(peer, ssm_svc_uuid, ssm_ntf_uuid, BLE_UUID16_DECLARE(BLE_GATT_DSC_CLT_CFG_UUID16));
+		const struct peer_chr * chr = peer_chr_find_uuid(peer, ssm_svc_uuid, ssm_chr_uuid);
+		if (dsc == NULL || chr == NULL) {
+			ESP_LOGE(TAG, "Error: Peer lacks a CCCD for the Unread Alert Status characteristic\n");
+			goto err;
+		}
+		cccd_handle = dsc->dsc.handle;
+		if (c != NULL) { // the handles don't change between connections, skip service discovery next time
+			c->cccd_handle = cccd_handle;
+			c->chr_handle = chr->chr.val_handle;
+		}
 	}
 	uint8_t value[2] = { 0x01, 0x00 };
-	int rc = ble_gattc_write_flat(conn_handle, dsc->dsc.handle, value, sizeof(value), NULL, NULL);
+	int rc = ble_gattc_write_flat(conn_handle, cccd_handle, value, sizeof(value), ssm_enable_notify_cb, ssm);
 	if (rc != 0) {
 		ESP_LOGE(TAG, "Error: Failed to subscribe to characteristic; rc=%d\n", rc);
 		goto err;
 	}
-	ESP_LOGW(TAG, "Enable notify success!!");
 	return ESP_OK;
 err:
-	return ble_gap_terminate(peer->conn_handle, BLE_ERR_REM_USER_CONN_TERM); /* Terminate the connection. */
+	return ble_gap_terminate(conn_handle, BLE_ERR_REM_USER_CONN_TERM); /* Terminate the connection. */
 }
 
 static void service_disc_complete(const struct peer * peer, int status, void * arg) {
-	// sesame * ssm = (sesame *) arg;
+	sesame * ssm = (sesame *) arg;
 	if (status != 0) {
 		ESP_LOGE(TAG, "Error: Service discovery failed; status=%d conn_handle=%d\n", status, peer->conn_handle);
 		ble_gap_terminate(peer->conn_handle, BLE_ERR_REM_USER_CONN_TERM);
 		return;
 	}
 	ESP_LOGI(TAG, "Service discovery complete conn_handle=%d\n", peer->conn_handle);
-	ssm_enable_notify(peer->conn_handle);
+	ssm_enable_notify(peer->conn_handle, ssm);
 }
 
 static int ble_gap_event_connect_handle(struct ble_gap_event * event, sesame * ssm) {
 	if (event->connect.status != 0) {
 		ESP_LOGE(TAG, "Error: Connection failed; status=%d\n", event->connect.status);
+		ssm_conn_reset(ssm);
+		ssm_sup_ble_link_down(ssm, "connection failed");
 		ble_hs_cfg.sync_cb(); // resume BLE scan
 		return ESP_FAIL;
 	}
@@ -62,12 +105,19 @@ static int ble_gap_event_connect_handle(struct ble_gap_event * event, sesame * s
 	rc = peer_add(event->connect.conn_handle);
 	if (rc != 0) {
 		ESP_LOGE(TAG, "Failed to add peer for %s with conn_id = %d; rc=%d\n", SSM_PRODUCT_TYPE_STR(ssm->product_type), event->connect.conn_handle, rc);
+		ssm_conn_reset(ssm);
 		ble_hs_cfg.sync_cb(); // resume BLE scan
 		return ESP_FAIL;
 	}
 	ssm->device_status = SSM_CONNECTED;		   // set the device status
 	ssm->conn_id = event->connect.conn_handle; // save the connection handle
+	ssm_boot_mark(SSM_BOOT_BLE_LINK);
 	ESP_LOGW(TAG, "Connect %s success handle=%d", SSM_PRODUCT_TYPE_STR(ssm->product_type), ssm->conn_id);
+	ssm_conn_advance(ssm, SSM_CONN_NOTIFY);
+	ssm_conn_t * c = ssm_conn_get(ssm);
+	if (c != NULL && c->cccd_handle != 0) { // reconnect, enable notification at once with the cached handle
+		return ssm_enable_notify(event->connect.conn_handle, ssm);
+	}
 	rc = peer_disc_all(event->connect.conn_handle, service_disc_complete, ssm);
 	if (rc != 0) {
 		ESP_LOGE(TAG, "Failed to discover services; rc=%d\n", rc);
@@ -80,12 +130,15 @@ static void reconnect_ssm(sesame * ssm) {
 	ble_addr_t addr;
 	addr.type = BLE_ADDR_RANDOM;
 	memcpy(addr.val, ssm->addr, 6);
+	ssm_conn_start(ssm);
 	int rc = ble_gap_connect(BLE_OWN_ADDR_PUBLIC, &addr, 30000, NULL, ble_gap_connect_event, ssm);
 	if (rc != 0) {
 		ESP_LOGE(TAG, "Error: Failed to connect to device; rc=%d\n", rc);
-		if ((ssm->product_type == SESAME_5 || ssm->product_type == SESAME_5_PRO) && ssm->mqtt_discovery_done) { // disconnect after MQTT discovery is done
-			esp_restart(); // 20241010
+		ssm_conn_reset(ssm);
+		if (rc == BLE_HS_ECONTROLLER || rc == BLE_HS_ETIMEOUT_HCI) { // the controller doesn't respond
+			ssm_sup_ble_stack_error(rc, 1);
 		}
+		ssm_sup_ble_link_down(ssm, "connect failed"); // e.g. another connection is pending, try again later
 		return;
 	}
 }
@@ -109,8 +162,8 @@ void reconnect(sesame * ssm) {
 }
 
 static int ble_gap_connect_event(struct ble_gap_event * event, void * arg) {
-	ESP_LOGI(TAG, "[ble_gap_connect_event: %d]", event->type);
 	sesame * ssm = (sesame *) arg;
+	SSM_LOG(SSM_EV_GAP_EVENT, event->type, ssm->conn_id, 0, 0);
 	switch (event->type) {
 	case BLE_GAP_EVENT_CONNECT:
 		return ble_gap_event_connect_handle(event, ssm);
@@ -119,22 +172,22 @@ static int ble_gap_connect_event(struct ble_gap_event * event, void * arg) {
 		ESP_LOGW(TAG, "%s disconnect; reason=%d ", SSM_PRODUCT_TYPE_STR(ssm->product_type), event->disconnect.reason);
 		ssm->device_status = SSM_DISCONNECTED;
 		ssm->conn_id = 0xFF;
+		ssm_conn_reset(ssm);
 		print_conn_desc(&event->disconnect.conn);
 		peer_delete(event->disconnect.conn.conn_handle);		
 		if (ssm->disconnect_forever) {
 			ssm->disconnect_forever = 0;
 			return ESP_OK;
 		}
+		ble_gap_disc_cancel(); // stop BLE scan, added on 2024.04.17 by JS
 		if (event->disconnect.reason == 531) { // Sesame teminate the connection. Should be caused by device reset
-			esp_restart();
-		} else if (event->disconnect.reason == 12) { // Sesame disconnect due to BLE_HS_ECONTROLLER
-			ESP_LOGE(TAG, "restart ESP, reason = 12");
-			esp_restart();
+			ssm_sup_ble_link_down(ssm, "terminated by device"); // logs in again on reconnect
+		} else if (event->disconnect.reason == BLE_HS_ECONTROLLER) { // the host is resetting after a controller error
+			ssm_sup_ble_stack_error(event->disconnect.reason, 0);
+			ssm_sup_ble_link_down(ssm, "controller error");
+		} else {
+			ssm_sup_ble_link_down(ssm, "disconnected");
 		}
-
-		ble_gap_disc_cancel(); // stop BLE scan, added on 2024.04.17 by JS
-		vTaskDelay(600 / portTICK_PERIOD_MS);
-		reconnect_ssm(ssm);
 		return ESP_OK;
 
 	case BLE_GAP_EVENT_CONN_UPDATE_REQ:
@@ -152,8 +205,7 @@ static int ble_gap_connect_event(struct ble_gap_event * event, void * arg) {
 		ssm_ble_receiver(ssm, event->notify_rx.om->om_data, event->notify_rx.om->om_len);
 		if (ssm->update_status) {
 			sesame_update();
-			mqtt_discovery();
-			mqtt_subscribe();
+			mqtt_sync_devices();
 		}
 		ble_hs_cfg.sync_cb(); // resume BLE scan
 		return ESP_OK;
@@ -167,54 +219,54 @@ static int ble_gap_connect_event(struct ble_gap_event * event, void * arg) {
 	}
 }
 
+static void ssm_rssi_sweep(void * arg) { // every minute, publish the RSSI statistics collected while scanning
+	char payload[80] = "";
+	for (int i_ssm = 0; i_ssm < cnt_ssms; i_ssm++) {
+		sesame *ssm = &(p_ssms_env + i_ssm)->ssm;
+		ssm_rssi_stats_t st;
+		int8_t rssi = ssm->rssi;
+		ssm->is_alive = ssm_rssi_take(ssm, &st);
+		if (ssm->is_alive) { // seen in this interval
+			ssm->rssi = st.ewma;
+			snprintf(payload, sizeof(payload), "{\"ewma\":%d,\"min\":%d,\"max\":%d,\"p10\":%d,\"p90\":%d,\"n\":%u}", st.ewma, st.min, st.max, st.p10, st.p90, st.n);
+			mqtt_publish_value(ssm, MQTT_VALUE_RSSI_STATS, payload); // every interval, for placing the bridge
+			if (ssm_telemetry_filter(ssm, SSM_METRIC_RSSI, st.ewma, NULL)) { // the sensor value only if it moved out of the deadband
+				snprintf(payload, sizeof(payload), "%d", st.ewma);
+				int msg_id = mqtt_publish_value(ssm, MQTT_VALUE_RSSI, payload); // kept while the broker is away
+				ESP_LOGI(TAG, "sent mqtt rssi for %s, msg_id=%d", ssm->topic, msg_id); // not waited for, the timer task doesn't block
+			}
+		} else if (ble_gap_disc_active()) { // not seen while scanning, with the scan paused keep the last value
+			if (ssm->rssi != -128) { // MQTT publish RSSI not available if never published
+				ssm->rssi = -128;
+				ssm_rssi_reset(ssm);
+				ssm_telemetry_reset(ssm, SSM_METRIC_RSSI); // publish the first value when it is back
+				int msg_id = mqtt_publish_value(ssm, MQTT_VALUE_RSSI, "None");
+				ESP_LOGI(TAG, "sent mqtt rssi not available for %s, msg_id=%d", ssm->topic, msg_id);
+			}
+		}
+		ssm->rssi_changed = (ssm->rssi != rssi);
+	}
+}
+
 static void ssm_scan_connect(const struct ble_hs_adv_fields * fields, void * disc) {
 	ble_addr_t * addr = &((struct ble_gap_disc_desc *) disc)->addr;
 	int8_t rssi = ((struct ble_gap_disc_desc *) disc)->rssi;
 	struct ssm_env_tag * p_tag = NULL;
 
-	if (timer_1min()) { // 1 min timeout, check RSSI
-		char topic[80] = "";
-		char payload[8] = "";
-		for (int i_ssm = 0; i_ssm < cnt_ssms; i_ssm++) {
-			sesame *ssm = &(p_ssms_env + i_ssm)->ssm;
-			memset(topic, 0, sizeof(topic));
-			sprintf(topic, "homeassistant/%s/state/rssi", ssm->topic); 
-			if (ssm->is_alive) { // MQTT publish RSSI if value is changed
-				if (ssm->rssi_changed) { 
-					memset(payload, 0, sizeof(payload));
-					sprintf(payload, "%d", ssm->rssi);
-					int msg_id = esp_mqtt_client_publish(client_ssm, topic, payload, 0, 2, 1); // QOS 2, retain 0
-					ESP_LOGI(TAG, "sent mqtt rssi for %s, msg_id=%d", ssm->topic, msg_id);
-					wait_published(msg_id);
-				}
-			} else {
-				if (ssm->rssi != -128) { // MQTT publish RSSI not available if never published
-					ssm->rssi = -128;
-					int msg_id = esp_mqtt_client_publish(client_ssm, topic, "None", 0, 2, 1); // QOS 2, retain 0
-					ESP_LOGI(TAG, "sent mqtt rssi not available for %s, msg_id=%d", ssm->topic, msg_id);
-					wait_published(msg_id);
-				}
-			}
-			ssm->is_alive = 0; // reset
-			ssm->rssi_changed = 0;
-		}
-	}
-
 	if (fields->mfg_data_len >= 5 && fields->mfg_data[0] == 0x5A && fields->mfg_data[1] == 0x05) { // is SSM
 		for (int n = 0; n < cnt_ssms; n++) {
 			sesame *ssm = &(p_ssms_env + n)->ssm;													   // skip if the device was discovered already
 			if (memcmp(ssm->addr, addr->val, sizeof(uint8_t) * 6) == 0) {
-				if ((ssm->product_type == SESAME_5 || ssm->product_type == SESAME_5_PRO) && ssm->device_status < SSM_LOGGIN) { // if Sesame 5 or Sesame 5 PRO is logout unexpectedly, restart ESP32
-					esp_restart(); // 20241009
+				if ((ssm->product_type == SESAME_5 || ssm->product_type == SESAME_5_PRO) && ssm->device_status < SSM_LOGGIN) { // if Sesame 5 or Sesame 5 PRO is logout unexpectedly, log in again
+					ssm_conn_t * c = ssm_conn_get(ssm);
+					if (c != NULL && c->phase == SSM_CONN_IDLE) {
+						ssm_sup_ble_link_down(ssm, "logged out");
+					}
 				}
 				if (++ssm->cnt_discovery > 128) { // accumulate the number of times this device has been discovered
 					ssm->cnt_discovery = 128;	   // avoid saturation and wrap around
 				}
-				if (!ssm->rssi_changed && rssi != ssm->rssi) {
-					ssm->rssi_changed = 1;
-				}
-				ssm->rssi = rssi;
-				ssm->is_alive = 1;
+				ssm_rssi_add(ssm, rssi); // ssm->rssi is set by the sweep
 				return;
 			}
 		}
@@ -253,9 +305,11 @@ static void ssm_scan_connect(const struct ble_hs_adv_fields * fields, void * dis
 		}
 		ble_gap_disc_cancel(); // stop scan
 		ESP_LOGW(TAG, "Connect %s addr=%s addrType=%d", SSM_PRODUCT_TYPE_STR(p_tag->ssm.product_type), addr_str(addr->val), addr->type);
+		ssm_conn_start(&p_tag->ssm);
 		int rc = ble_gap_connect(BLE_OWN_ADDR_PUBLIC, addr, 30000, NULL, ble_gap_connect_event, &p_tag->ssm);
 		if (rc != 0) {
 			ESP_LOGE(TAG, "Error: Failed to connect to device; rc=%d\n", rc);
+			ssm_conn_reset(&p_tag->ssm);
 			ble_hs_cfg.sync_cb(); // resume BLE scan
 			return;
 		}
@@ -275,7 +329,100 @@ static int ble_gap_disc_event(struct ble_gap_event * event, void * arg) {
 	return ESP_OK;
 }
 
+#if CONFIG_SSM_SCAN_REGISTERED_ONLY
+static int blecent_set_accept_list(void) { // accept advertisements of the registered devices only, return the number of devices
+	uint8_t addrs[SSM_MAX_NUM][6];
+	ble_addr_t wl[SSM_MAX_NUM];
+	int cnt = ssm_nvs_registry_addrs(addrs, SSM_MAX_NUM);
+	for (int n = 0; n < cnt; n++) {
+		wl[n].type = BLE_ADDR_RANDOM;
+		memcpy(wl[n].val, addrs[n], 6);
+	}
+	if (cnt > 0) {
+		int rc = ble_gap_wl_set(wl, cnt);
+		if (rc != 0) {
+			ESP_LOGE(TAG, "Error setting filter accept list; rc=%d", rc);
+			return 0;
+		}
+	}
+	return cnt;
+}
+#endif
+
+#if CONFIG_SSM_WARM_START
+#define SSM_WARM_CONNECT_MS 3000 // a device in range advertises several times meanwhile
+
+static uint8_t warm_addrs[SSM_MAX_NUM][6];
+static int8_t cnt_warm = -1; // registered devices connected without waiting for their advertisement, -1 until the first sync
+static uint8_t idx_warm = 0;
+
+static void blecent_warm_release(sesame * ssm) { // the slot at cnt_ssms was not claimed, leave it as ssm_init() did for a scan to take
+	ssm_conn_reset(ssm);
+	memset(ssm, 0, sizeof(sesame));
+	ssm->conn_id = 0xFF;
+	ssm->id = 0xFF;
+	ssm->device_status = SSM_NOUSE;
+	ssm->mech.lock_unlock.lock = 160;
+	ssm->mech.lock_unlock.unlock = 20;
+}
+
+static int ble_gap_warm_event(struct ble_gap_event * event, void * arg) {
+	if (event->type == BLE_GAP_EVENT_CONNECT && event->connect.status != 0) { // not in range, it is connected when its advertisement is seen
+		ESP_LOGW(TAG, "warm connect to %s failed; status=%d", SSM_PRODUCT_TYPE_STR(((sesame *) arg)->product_type), event->connect.status);
+		blecent_warm_release((sesame *) arg);
+		ble_hs_cfg.sync_cb(); // next device or scan
+		return ESP_OK;
+	}
+	return ble_gap_connect_event(event, arg);
+}
+
+static int blecent_warm_connect(void) { // connect the next registered device from the registry, return 1 if one is pending
+	if (cnt_warm < 0) {
+		cnt_warm = ssm_nvs_registry_addrs(warm_addrs, SSM_MAX_NUM);
+	}
+	while (idx_warm < cnt_warm) {
+		if (ble_gap_conn_active()) { // one connection at a time, continued by sync_cb after it is up
+			return 1;
+		}
+		const uint8_t * addr = warm_addrs[idx_warm++];
+		uint8_t product_type = ssm_nvs_registry_product(addr);
+		int found = (product_type == 0 || cnt_ssms >= SSM_MAX_NUM); // product type unknown, wait for the advertisement
+		for (int n = 0; n < cnt_ssms && !found; n++) {
+			found = (memcmp(p_ssms_env[n].ssm.addr, addr, 6) == 0);
+		}
+		if (found) {
+			continue;
+		}
+		sesame * ssm = &(p_ssms_env + cnt_ssms)->ssm; // same slot as a device found by scan
+		memcpy(ssm->addr, addr, 6);
+		ssm->product_type = product_type;
+		if (ssm_read_nvs(ssm) == 0) {
+			blecent_warm_release(ssm);
+			continue;
+		}
+		ble_addr_t peer_addr = { .type = BLE_ADDR_RANDOM };
+		memcpy(peer_addr.val, addr, 6);
+		ESP_LOGW(TAG, "Warm connect %s addr=%s", SSM_PRODUCT_TYPE_STR(ssm->product_type), addr_str(addr));
+		ssm_conn_start(ssm);
+		int rc = ble_gap_connect(BLE_OWN_ADDR_PUBLIC, &peer_addr, SSM_WARM_CONNECT_MS, NULL, ble_gap_warm_event, ssm);
+		if (rc != 0) {
+			ESP_LOGE(TAG, "Error: Failed to connect to device; rc=%d\n", rc);
+			blecent_warm_release(ssm);
+			continue;
+		}
+		return 1;
+	}
+	return 0;
+}
+#endif
+
 static void blecent_scan(void) {
+	ssm_boot_mark(SSM_BOOT_BLE_SYNC);
+#if CONFIG_SSM_WARM_START
+	if (blecent_warm_connect()) { // scan after the registered devices were tried
+		return;
+	}
+#endif
 	if (ble_gap_disc_active()) { // blecent scan is ongoing
 		return;
 	}
@@ -287,6 +434,11 @@ static void blecent_scan(void) {
 	disc_params.window = 0;
 	disc_params.filter_policy = 0;
 	disc_params.limited = 0;
+#if CONFIG_SSM_SCAN_REGISTERED_ONLY
+	if (blecent_set_accept_list() > 0) { // scan all devices until one is registered
+		disc_params.filter_policy = BLE_HCI_SCAN_FILT_USE_WL;
+	}
+#endif
 
 	int rc = ble_gap_disc(BLE_OWN_ADDR_PUBLIC, BLE_HS_FOREVER, &disc_params, ble_gap_disc_event, NULL);
 	if (rc != 0) {
@@ -301,29 +453,37 @@ static void blecent_host_task(void * param) {
 }
 
 void esp_ble_gatt_write(sesame * ssm, uint8_t * value, uint16_t length) {
-	const struct peer * peer = peer_find(ssm->conn_id);
-	const struct peer_chr * chr = peer_chr_find_uuid(peer, ssm_svc_uuid, ssm_chr_uuid);
-	if (chr == NULL) {
-		ESP_LOGE(TAG, "Error: Peer doesn't have the subscribable characteristic\n");
-		return;
+	ssm_conn_t * c = ssm_conn_get(ssm);
+	uint16_t chr_handle = (c != NULL) ? c->chr_handle : 0;
+	if (chr_handle == 0) {
+		const struct peer * peer = peer_find(ssm->conn_id);
+		const struct peer_chr * chr = peer_chr_find_uuid(peer, ssm_svc_uuid, ssm_chr_uuid);
+		if (chr == NULL) {
+			ESP_LOGE(TAG, "Error: Peer doesn't have the subscribable characteristic\n");
+			return;
+		}
+		chr_handle = chr->chr.val_handle;
 	}
-	int rc = ble_gattc_write_flat(ssm->conn_id, chr->chr.val_handle, value, length, NULL, NULL);
+	int rc = ble_gattc_write_flat(ssm->conn_id, chr_handle, value, length, NULL, NULL);
 	if (rc != 0) {
 		ESP_LOGE(TAG, "Error: Failed to write to the subscribable characteristic; rc=%d\n", rc);
 	}
 }
 
 void esp_ble_init(void) {
+	ssm_boot_mark(SSM_BOOT_BLE_INIT);
 	esp_err_t ret = nimble_port_init();
 	if (ret != ESP_OK) {
 		ESP_LOGE(TAG, "Failed to init nimble %d ", ret);
-		esp_mqtt_client_publish(client_ssm, "12345", "Failed to init nimble", 0, 2, 0); // QOS 2, retain 1
+		mqtt_publish("12345", "Failed to init nimble", MQTT_CLASS_STATE);
 		return;
 	}
+	ssm_crypto_host_init();
 	ble_hs_cfg.sync_cb = blecent_scan;
 	int rc = peer_init(SSM_MAX_NUM, 64, 64, 64);
 	assert(rc == 0);
 	nimble_port_freertos_init(blecent_host_task);
+	ssm_timer_start(ssm_rssi_sweep, NULL, 60000, 60000);
 	ESP_LOGI(TAG, "[esp_ble_init][SUCCESS]");
 }
 
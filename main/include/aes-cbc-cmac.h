@@ -40,6 +40,14 @@ extern "C" {
 void AES_CMAC(const unsigned char *key, const unsigned char *input, int length,
 		unsigned char *mac);
 
+/* Subkeys K1 and K2 only depend on the key, generate them once per key and
+ * pass them to AES_CMAC_PRECOMPUTED to save one block encryption per MAC */
+void AES_CMAC_SUBKEY(const unsigned char *key, unsigned char *K1, unsigned char *K2);
+
+void AES_CMAC_PRECOMPUTED(const unsigned char *key, const unsigned char *K1,
+		const unsigned char *K2, const unsigned char *input, int length,
+		unsigned char *mac);
+
 int AES_CMAC_CHECK(const unsigned char *key, const unsigned char *input,
 		int length, const unsigned char *mac);
 
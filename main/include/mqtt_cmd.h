@@ -0,0 +1,59 @@
+#ifndef __MQTT_CMD_H__
+#define __MQTT_CMD_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+	const char * ptr; // points into the MQTT payload, NOT NUL terminated
+	uint16_t len;
+} mqtt_cmd_str_t;
+
+typedef struct {
+	mqtt_cmd_str_t action; // "action"
+	mqtt_cmd_str_t code;   // "code"
+	mqtt_cmd_str_t mac;	   // "mac" or "addr", format aa:bb:cc:dd:ee:ff
+	int16_t position;	   // "lock", "unlock" or "position", in degree
+	uint8_t has_position;
+} mqtt_cmd_t;
+
+int mqtt_cmd_parse(const char * data, int len, mqtt_cmd_t * cmd); // parse command payload in place, return 1 if an action is found
+
+int mqtt_cmd_str_eq(const mqtt_cmd_str_t * str, const char * literal);
+
+int mqtt_cmd_mac_to_addr(const mqtt_cmd_str_t * mac, uint8_t * addr); // convert "aa:bb:cc:dd:ee:ff" to BLE address byte order, return 1 if valid
+
+// To support a new command, add its handler in mqtt_section.c and one line here: name, handler, first and middle letter
+// of the name (name[len / 2]). The letters key the hash, a collision with another action fails the build and a wrong
+// letter fails the host test
+#define MQTT_ACTION_LIST(X)                                             \
+	X("lock", mqtt_action_lock, 'l', 'c')                               \
+	X("unlock", mqtt_action_unlock, 'u', 'o')                           \
+	X("magnet", mqtt_action_magnet, 'm', 'n')                           \
+	X("gen_qr_code_text", mqtt_action_gen_qr_code_text, 'g', 'o')       \
+	X("add_sesame", mqtt_action_add_sesame, 'a', 'e')                   \
+	X("remove_sesame", mqtt_action_remove_sesame, 'r', '_')             \
+	X("add_finger", mqtt_action_add_finger, 'a', 'i')                   \
+	X("verify_finger", mqtt_action_verify_finger, 'v', '_')             \
+	X("add_card", mqtt_action_add_card, 'a', 'c')                       \
+	X("verify_card", mqtt_action_verify_card, 'v', 'y')                 \
+	X("disconnect_touch", mqtt_action_disconnect_touch, 'd', 'c')       \
+	X("reconnect_touch", mqtt_action_reconnect_touch, 'r', 'c')         \
+	X("set_lock_position", mqtt_action_set_lock_position, 's', '_')     \
+	X("set_unlock_position", mqtt_action_set_unlock_position, 's', 'k') \
+	X("battery_update", mqtt_action_battery_update, 'b', '_')           \
+	X("dump_log", mqtt_action_dump_log, 'd', '_')
+
+#define MQTT_ACTION_ID(name, fn, first, middle) fn##_id,
+enum { MQTT_ACTION_LIST(MQTT_ACTION_ID) MQTT_ACTION_NUM };
+
+int mqtt_action_find(const mqtt_cmd_str_t * action); // index of action in MQTT_ACTION_LIST, -1 if unknown
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __MQTT_CMD_H__
@@ -0,0 +1,29 @@
+#ifndef __MQTT_OUTBOX_H__
+#define __MQTT_OUTBOX_H__
+
+#include "ssm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+	MQTT_VALUE_STATE = 0, // homeassistant/<topic>/state, the JSON with state, battery and positions
+	MQTT_VALUE_RSSI,	  // homeassistant/<topic>/state/rssi
+	MQTT_VALUE_RSSI_STATS, // homeassistant/<topic>/state/rssi_stats, the JSON attributes of the RSSI sensor
+	MQTT_VALUE_NUM,
+} mqtt_value_t;
+
+void mqtt_outbox_init(void); // called by ssm_init()
+
+int mqtt_publish_value(sesame * ssm, mqtt_value_t value, const char * payload); // publish now if the broker is connected, else keep the latest payload until it is. A failed publish is kept and retried. Return the msg_id, 0 if kept or sent with QoS 0
+
+void mqtt_outbox_connected(uint8_t connected); // broker connection changed, the kept values are published after a reconnect
+
+void mqtt_outbox_flush(void); // publish the kept values if the broker is connected
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __MQTT_OUTBOX_H__
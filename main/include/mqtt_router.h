@@ -0,0 +1,18 @@
+#ifndef __MQTT_ROUTER_H__
+#define __MQTT_ROUTER_H__
+
+#include "ssm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void mqtt_router_add(sesame * ssm); // route homeassistant/s2mxxxxxxxxxxxx/set[/...] to ssm
+
+sesame * mqtt_router_find(const char * topic, int topic_len); // return NULL if the topic is not a command topic of a known device
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __MQTT_ROUTER_H__
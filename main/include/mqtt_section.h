@@ -7,21 +7,46 @@ extern "C" {
 
 #include "mqtt_client.h"
 
+typedef enum {
+	MQTT_CLASS_STATE = 0, // device state, e.g. qr_code_text, add_sesame
+	MQTT_CLASS_TELEMETRY, // rssi, battery
+	MQTT_CLASS_CONFIG,	  // Home Assistant discovery config
+	MQTT_CLASS_COMMAND,	  // command topics, subscribed by us and published by Home Assistant
+	MQTT_CLASS_NUM,
+} mqtt_msg_class_t;
+
+typedef struct {
+	uint8_t qos;
+	uint8_t retain;
+} mqtt_qos_policy_t;
+
+extern const mqtt_qos_policy_t mqtt_qos_policy[MQTT_CLASS_NUM];
+
 extern int mqtt_init_done;
 extern int msg_id_subscribed;
 extern char config_broker_url[60];
 extern esp_mqtt_client_handle_t client_ssm;
 
+int mqtt_publish(const char * topic, const char * payload, mqtt_msg_class_t msg_class); // publish with the QoS and retain flag of msg_class
+
+int mqtt_publish_status(sesame * ssm); // publish the JSON of homeassistant/<topic>/state through the outbox
+
 int wait_published(int msg_id);
 
 int wake_up(sesame * ssm);
 
 void mqtt_start(void);
 
+void mqtt_start_background(void); // wifi_init_sta() and mqtt_start() in their own task, so BLE login proceeds meanwhile
+
+int mqtt_starting(void); // 1 while mqtt_start() waits for the broker, device status is held back until then
+
 void mqtt_discovery(void);
 
 void mqtt_subscribe(void);
 
+void mqtt_sync_devices(void); // discovery, subscription and status of the devices logged in since the last call, skipped while starting
+
 #ifdef __cplusplus
 }
 #endif
@@ -71,12 +71,15 @@ typedef struct {
 	uint8_t is_new;							 // 20240516 by JS
 	uint8_t mqtt_discovery_done;			 // 20240524 by JS
 	uint8_t mqtt_subscribe_done;			 // 20240524 by JS
-	double battery_percentage;				 // 20240526 by JS
+	uint8_t battery_percentage;				 // 20240526 by JS, 0 to 100. Was a double, see ssm_battery_percentage()
 	uint8_t disconnect_forever;				 // 20240605 by JS
 	uint8_t update_status;				 	 // 20240605 by JS
 	int8_t rssi;							 // 20240604 by JS
-	uint8_t is_alive;						 // 20240605 by JS
-	uint8_t rssi_changed;					 // 20240605 by JS
+	uint8_t is_alive;						 // 20240605 by JS, seen in the last RSSI interval
+	uint8_t rssi_changed;					 // 20240605 by JS, rssi changed at the last RSSI sweep
+	uint8_t cmac_subkey[2][16];				 // AES-CMAC subkeys K1 and K2 of device_secret
+	uint8_t cmac_subkey_valid;				 // 0: derive cmac_subkey from device_secret before the next login
+	uint16_t battery_raw;					 // mech_status.battery of battery_percentage
 } sesame;
 
 typedef void (*ssm_action)(sesame * ssm);
@@ -94,6 +97,8 @@ extern uint8_t real_num_ssms;
 extern uint8_t cnt_unregistered_ssms;
 extern struct timeval tv_start, tv_1min;
 
+// Polling timers of the old main loop, kept for existing callers. They now run on the monotonic clock of
+// ssm_timer_now_us(); new code schedules its work with ssm_timer_start() instead
 int timer_1min(); // timer for 1 minute
 
 int loop_timeout();
@@ -114,6 +119,8 @@ void ssm_init(ssm_action ssm_action_cb);
 
 void gen_qr_code_txt(sesame * ssm, char * qr);
 
+double ssm_battery_percentage(const sesame * ssm); // battery_percentage as the double it used to be, e.g. for "%f"
+
 int wait_for_status_update(sesame * ssm, uint8_t timeout_s); // wait for status update for at most timeout_s seconds
 
 #ifdef __cplusplus
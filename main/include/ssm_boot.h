@@ -0,0 +1,38 @@
+#ifndef __SSM_BOOT_H__
+#define __SSM_BOOT_H__
+
+#include "ssm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+	SSM_BOOT_APP_MAIN = 0, // app_main() entered
+	SSM_BOOT_NVS,		   // nvs_flash_init() done
+	SSM_BOOT_REGISTRY,	   // registered devices loaded from NVS
+	SSM_BOOT_WIFI_START,   // wifi_init_sta() entered
+	SSM_BOOT_WIFI_IP,	   // got an IP address
+	SSM_BOOT_MQTT_CLEAN,   // clean session connected, cold start only
+	SSM_BOOT_MQTT_READY,   // persistent session connected
+	SSM_BOOT_BLE_INIT,	   // esp_ble_init() entered
+	SSM_BOOT_BLE_SYNC,	   // NimBLE host synced with the controller
+	SSM_BOOT_BLE_LINK,	   // first device connected
+	SSM_BOOT_BLE_LOGIN,	   // first device logged in
+	SSM_BOOT_BLE_ALL,	   // all registered devices logged in
+	SSM_BOOT_NUM,
+} ssm_boot_phase_t;
+
+void ssm_boot_mark(ssm_boot_phase_t phase); // record the first time phase is reached, published to MQTT once the broker is ready
+
+void ssm_boot_device_ready(sesame * ssm); // ssm logged in, marks SSM_BOOT_BLE_LOGIN and SSM_BOOT_BLE_ALL
+
+int ssm_boot_warm(const char * broker); // 1 if the persistent session on broker was established in an earlier boot
+
+void ssm_boot_save_warm(const char * broker); // remember the broker of the persistent session, NULL to do a cold start next boot
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __SSM_BOOT_H__
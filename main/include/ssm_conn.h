@@ -0,0 +1,62 @@
+#ifndef __SSM_CONN_H__
+#define __SSM_CONN_H__
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "ssm.h"
+#include "ssm_sup.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+	SSM_CONN_IDLE = 0,	  // not connected
+	SSM_CONN_LINK = 1,	  // ble_gap_connect() started, waiting for the link
+	SSM_CONN_NOTIFY = 2,  // link is up, enabling notification
+	SSM_CONN_INITIAL = 3, // notification enabled, waiting for SSM_ITEM_CODE_INITIAL
+	SSM_CONN_LOGIN = 4,	  // login sent, waiting for the response
+	SSM_CONN_READY = 5,	  // logged in, commands are accepted
+} ssm_conn_phase_t;
+
+#define SSM_CONN_EVENT_STATUS (1 << 0)	 // SSM_ITEM_CODE_MECH_STATUS was received
+#define SSM_CONN_EVENT_CMD_DONE (1 << 1) // the queued command was sent
+
+typedef void (*ssm_conn_cmd)(sesame * ssm, sesame * peer); // user command, peer is the other device of tch_add_sesame() etc.
+
+typedef struct {
+	volatile uint8_t phase;
+	int64_t t_start_us;	  // esp_timer_get_time() when the connection was started
+	int32_t ready_ms;	  // connect to command ready of the last connection, 0 if never ready
+	uint16_t chr_handle;  // GATT handles cached from the first service discovery, 0 if unknown
+	uint16_t cccd_handle;
+	ssm_conn_cmd cmd;	  // queued user command, sent as soon as the device is logged in
+	sesame * cmd_peer;
+	volatile uint8_t cmd_done;
+	EventGroupHandle_t events; // SSM_CONN_EVENT_*, created by ssm_conn_init()
+	ssm_backoff_t backoff;	   // reconnect backoff, reset on login
+} ssm_conn_t;
+
+void ssm_conn_init(void); // called by ssm_init()
+
+ssm_conn_t * ssm_conn_get(sesame * ssm); // NULL if ssm is not in p_ssms_env
+
+void ssm_conn_start(sesame * ssm); // ble_gap_connect() is called for ssm
+
+void ssm_conn_advance(sesame * ssm, ssm_conn_phase_t phase); // ssm reached phase, runs the queued command when ready
+
+void ssm_conn_reset(sesame * ssm); // ssm is disconnected, drops the queued command
+
+void ssm_conn_notify(sesame * ssm, EventBits_t bits); // set events of ssm and wake up the waiters
+
+void ssm_conn_clear(sesame * ssm, EventBits_t bits); // forget events received before, e.g. before a reconnect
+
+int ssm_conn_wait(sesame * ssm, EventBits_t bits, uint32_t timeout_ms); // block until one of bits is set and clear it, return 0 on timeout
+
+int ssm_conn_run(sesame * ssm, ssm_conn_cmd cmd, sesame * peer, uint8_t timeout_s); // connect if needed and run cmd once logged in, return 1 if cmd was sent
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __SSM_CONN_H__
@@ -0,0 +1,26 @@
+#ifndef __SSM_CRYPTO_H__
+#define __SSM_CRYPTO_H__
+
+#include "ssm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void (*ssm_crypto_done)(sesame * ssm, int ok); // called in the NimBLE host task when the job is finished
+
+void ssm_crypto_init(void); // start the crypto worker and pre-generate an ephemeral key pair
+
+void ssm_crypto_host_init(void); // called by esp_ble_init() after nimble_port_init(), the events of the completions need the NimBLE port
+
+int ssm_crypto_take_key(uint8_t * public_key, uint8_t * private_key); // take the pre-generated key pair, return 0 if none is ready
+
+int ssm_crypto_make_key(sesame * ssm, uint8_t * public_key, uint8_t * private_key, ssm_crypto_done done); // generate a P-256 key pair in the worker. Return 0 if the job was not queued, done is not called then
+
+int ssm_crypto_shared_secret(sesame * ssm, const uint8_t * public_key, const uint8_t * private_key, uint8_t * secret, ssm_crypto_done done); // ECDH in the worker. Return 0 if the job was not queued, done is not called then
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __SSM_CRYPTO_H__
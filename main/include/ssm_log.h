@@ -0,0 +1,61 @@
+#ifndef __SSM_LOG_H__
+#define __SSM_LOG_H__
+
+#include "sdkconfig.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SSM_LOG_E 1
+#define SSM_LOG_W 2
+#define SSM_LOG_I 3
+#define SSM_LOG_D 4
+
+// How an argument is printed by ssm_log_dump(), formatting is deferred until then
+typedef enum {
+	SSM_LOG_ARG_NONE = 0,
+	SSM_LOG_ARG_INT,
+	SSM_LOG_ARG_HEX,
+	SSM_LOG_ARG_PRODUCT, // candy_product_type
+	SSM_LOG_ARG_OP,		 // ssm_op_code_e
+	SSM_LOG_ARG_ITEM,	 // ssm_item_code_e
+} ssm_log_arg_t;
+
+// Events of the hot paths: id, level, format with one %s per argument, how each of the 4 arguments is printed.
+// To log a new event, add one line here and call SSM_LOG() with its id
+#define SSM_LOG_EVENTS(X)                                                                                       \
+	X(SSM_EV_BLE_RX, SSM_LOG_I, "[%s][say][%s][%s][%s]", PRODUCT, INT, OP, ITEM)                                \
+	X(SSM_EV_BLE_TX, SSM_LOG_I, "[esp32][say][%s][%s]", INT, ITEM, NONE, NONE)                                  \
+	X(SSM_EV_MECH_STATUS, SSM_LOG_I, "battery=%s target=%s position=%s flags=0x%s", INT, INT, INT, HEX)         \
+	X(SSM_EV_GAP_EVENT, SSM_LOG_D, "[ble_gap_connect_event: %s] conn_id=%s", INT, INT, NONE, NONE)              \
+	X(SSM_EV_MQTT_DATA, SSM_LOG_I, "mqtt data for %s len=%s qos=%s retain=%s", PRODUCT, INT, INT, INT)          \
+	X(SSM_EV_MQTT_SUBSCRIBED, SSM_LOG_I, "mqtt subscribed msg_id=%s", INT, NONE, NONE, NONE)                    \
+	X(SSM_EV_MQTT_PUBLISHED, SSM_LOG_I, "mqtt published msg_id=%s", INT, NONE, NONE, NONE)
+
+#define SSM_LOG_EVENT_ID(id, level, fmt, t0, t1, t2, t3) id,
+typedef enum { SSM_LOG_EVENTS(SSM_LOG_EVENT_ID) SSM_EV_NUM } ssm_log_event_t;
+#undef SSM_LOG_EVENT_ID
+
+#define SSM_LOG_EVENT_LEVEL(id, level, fmt, t0, t1, t2, t3) id##_LEVEL = level,
+enum { SSM_LOG_EVENTS(SSM_LOG_EVENT_LEVEL) };
+#undef SSM_LOG_EVENT_LEVEL
+
+void ssm_log_put(ssm_log_event_t id, int32_t a0, int32_t a1, int32_t a2, int32_t a3); // a few stores into the RAM ring, safe from any task
+
+void ssm_log_dump(void); // print the ring on the console, oldest record first
+
+// The level is a constant, an event above CONFIG_SSM_LOG_LEVEL is compiled out with its arguments
+#define SSM_LOG(id, a0, a1, a2, a3)                                                                            \
+	do {                                                                                                       \
+		if (id##_LEVEL <= CONFIG_SSM_LOG_LEVEL) {                                                              \
+			ssm_log_put(id, (int32_t) (a0), (int32_t) (a1), (int32_t) (a2), (int32_t) (a3));                   \
+		}                                                                                                      \
+	} while (0)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __SSM_LOG_H__
@@ -0,0 +1,26 @@
+#ifndef __SSM_NVS_H__
+#define __SSM_NVS_H__
+
+#include "ssm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void ssm_nvs_init(void); // called by ssm_init() before any other ssm_nvs function
+
+int ssm_nvs_load_registry(void); // enumerate the registered devices in NVS into RAM once at boot, return the number of devices
+
+int ssm_nvs_registry_addrs(uint8_t (*addrs)[6], int max); // copy the addresses of the registered devices, return the number copied
+
+uint8_t ssm_nvs_registry_product(const uint8_t * addr); // product type of a registered device, 0 if unknown, e.g. migrated from the legacy layout
+
+void ssm_nvs_stage(sesame * ssm); // persist the changed state of ssm with the next deferred commit
+
+void ssm_nvs_flush(void); // commit all staged changes now, e.g. before restart
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __SSM_NVS_H__
@@ -0,0 +1,31 @@
+#ifndef __SSM_RSSI_H__
+#define __SSM_RSSI_H__
+
+#include "ssm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+	int8_t ewma; // smoothed over all samples, carried across intervals
+	int8_t min;
+	int8_t max;
+	int8_t p10; // percentiles of the latest SSM_RSSI_RING samples of the interval
+	int8_t p90;
+	uint16_t n; // samples in the interval
+} ssm_rssi_stats_t;
+
+void ssm_rssi_init(void);
+
+void ssm_rssi_add(sesame * ssm, int8_t rssi); // one advertisement of ssm was received
+
+int ssm_rssi_take(sesame * ssm, ssm_rssi_stats_t * stats); // statistics of the interval since the last call, which starts a new one. Return 0 if no sample was received
+
+void ssm_rssi_reset(sesame * ssm); // ssm is out of range, the next sample restarts the EWMA
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __SSM_RSSI_H__
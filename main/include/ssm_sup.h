@@ -0,0 +1,30 @@
+#ifndef __SSM_SUP_H__
+#define __SSM_SUP_H__
+
+#include "ssm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+	uint16_t failures; // consecutive failures since the link was last up
+} ssm_backoff_t;
+
+uint32_t ssm_backoff_next(ssm_backoff_t * b, uint32_t base_ms); // delay before the next retry: base_ms doubled per failure with jitter, capped at CONFIG_SSM_BACKOFF_MAX_S
+
+void ssm_backoff_reset(ssm_backoff_t * b); // the link is up
+
+void ssm_sup_ble_link_up(sesame * ssm); // ssm logged in
+
+void ssm_sup_ble_link_down(sesame * ssm, const char * why); // reconnect ssm after its backoff delay, the other devices are not touched
+
+void ssm_sup_ble_stack_error(int reason, uint8_t reset); // the BLE stack failed, reset the NimBLE host and controller if the host doesn't do it already, restart if it doesn't recover
+
+void ssm_sup_restart(const char * why); // last resort: commit NVS and restart
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __SSM_SUP_H__
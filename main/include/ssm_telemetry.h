@@ -0,0 +1,27 @@
+#ifndef __SSM_TELEMETRY_H__
+#define __SSM_TELEMETRY_H__
+
+#include "ssm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+	SSM_METRIC_RSSI = 0, // dBm
+	SSM_METRIC_BATTERY,	 // percent
+	SSM_METRIC_POSITION, // mech_status.position
+	SSM_METRIC_NUM,
+} ssm_metric_t;
+
+int ssm_telemetry_filter(sesame * ssm, ssm_metric_t metric, int32_t value, uint32_t * wait_ms); // 1 if value left the deadband of the last published one and the minimum interval passed, it is then the published one. Else *wait_ms is the time until a held change may be published, 0 if nothing is held
+
+void ssm_telemetry_reset(sesame * ssm, ssm_metric_t metric); // the next value is published whatever it is, e.g. after the metric was unavailable
+
+int ssm_telemetry_status(sesame * ssm, uint8_t state_changed); // 1 if the new mech status is worth the status callback now. A held battery or position change is published later from the timer task, without the callback
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __SSM_TELEMETRY_H__
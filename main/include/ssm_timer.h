@@ -0,0 +1,26 @@
+#ifndef __SSM_TIMER_H__
+#define __SSM_TIMER_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void (*ssm_timer_cb)(void * arg); // runs in the timer service task, keep it short
+
+int64_t ssm_timer_now_us(void); // monotonic time since boot, not affected by SNTP or settimeofday()
+
+void ssm_timer_init(void); // start the timer service task, called once by ssm_init() before any ssm_timer_start()
+
+int ssm_timer_start(ssm_timer_cb cb, void * arg, uint32_t delay_ms, uint32_t period_ms); // call cb(arg) after delay_ms, then every period_ms if not 0. A timer is identified by cb and arg, starting it again re-arms it. Return 0 if the table is full
+
+void ssm_timer_stop(ssm_timer_cb cb, void * arg); // cancel the timer of cb and arg if it is pending
+
+int ssm_timer_pending(ssm_timer_cb cb, void * arg); // 1 if the timer of cb and arg is armed
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __SSM_TIMER_H__
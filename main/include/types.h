@@ -7,7 +7,20 @@
 extern "C" {
 #endif
 
+/* asm_arm.inc and asm_avr.inc are not shipped, so only the platforms with a C multiply kernel
+   are detected here. The mulhu/muluh kernels of asm_riscv.inc and asm_xtensa.inc are not
+   selected until test/host/test_uecc.c has passed on the target; build with
+   -DuECC_PLATFORM=uECC_riscv or uECC_xtensa to try them. Everything else gets the generic
+   32-bit code. */
+#ifndef uECC_PLATFORM
+#if defined(__amd64__) || defined(_M_X64)
+#define uECC_PLATFORM uECC_x86_64
+#elif defined(__aarch64__)
+#define uECC_PLATFORM uECC_arm64
+#else
 #define uECC_PLATFORM uECC_arch_other
+#endif
+#endif
 
 #ifndef uECC_PLATFORM
 #if __AVR__
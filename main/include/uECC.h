@@ -16,6 +16,8 @@ Possible values for uECC_PLATFORM are defined below: */
 #define uECC_arm_thumb2 5
 #define uECC_arm64 6
 #define uECC_avr 7
+#define uECC_riscv 8
+#define uECC_xtensa 9
 
 /* If desired, you can define uECC_WORD_SIZE as appropriate for your platform (1, 4, or 8 bytes).
 If uECC_WORD_SIZE is not explicitly defined then it will be automatically set based on your
@@ -37,6 +39,13 @@ faster somewhat faster, but increases the code size. */
 #define uECC_SQUARE_FUNC 0
 #endif
 
+/* uECC_SECP256R1_COMB - If enabled (defined as nonzero), secp256r1 public keys are computed with a
+fixed-base comb over a precomputed table of generator multiples (1984 bytes of const data)
+instead of the generic Montgomery ladder. Key generation gets several times faster. */
+#ifndef uECC_SECP256R1_COMB
+#define uECC_SECP256R1_COMB 1
+#endif
+
 /* uECC_VLI_NATIVE_LITTLE_ENDIAN - If enabled (defined as nonzero), this will switch to native
 little-endian format for *all* arrays passed in and out of the public API. This includes public
 and private keys, shared secrets, signatures and message hashes.
@@ -52,12 +61,14 @@ the same endianness. */
 #define uECC_VLI_NATIVE_LITTLE_ENDIAN 1
 #endif
 
-/* Curve support selection. Set to 0 to remove that curve. */
+/* Curve support selection. Set to 0 to remove that curve.
+   The Sesame protocol only uses secp256r1. When it is the only curve, the curve parameters and
+   the fast reduction are compile-time constants instead of being read from the curve struct. */
 #ifndef uECC_SUPPORTS_secp160r1
 #define uECC_SUPPORTS_secp160r1 0
 #endif
 #ifndef uECC_SUPPORTS_secp192r1
-#define uECC_SUPPORTS_secp192r1 1
+#define uECC_SUPPORTS_secp192r1 0
 #endif
 #ifndef uECC_SUPPORTS_secp224r1
 #define uECC_SUPPORTS_secp224r1 0
@@ -1,19 +1,24 @@
 #include "blecent.h"
 #include "nvs_flash.h"
+#include "ssm_boot.h"
 #include "ssm_cmd.h"
+#include "mqtt_section.h"
 
 static const char * TAG = "main.c";
 
 static void ssm_action_handle(sesame * ssm) {
     ESP_LOGI(TAG, "[ssm_action_handle][ssm status: %s]", SSM_STATUS_STR(ssm->device_status));
+    mqtt_publish_status(ssm);
     if (ssm->device_status == SSM_UNLOCKED) {
         ssm_lock(ssm, NULL, 0);
     }
 }
 
 void app_main(void) {
+    ssm_boot_mark(SSM_BOOT_APP_MAIN);
     ESP_LOGI(TAG, "SesameSDK_ESP32 [11/24][087]");
     nvs_flash_init();
+    ssm_boot_mark(SSM_BOOT_NVS);
     ssm_init(ssm_action_handle);
     esp_ble_init();
 }
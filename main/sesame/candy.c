@@ -0,0 +1,29 @@
+/*
+ * Names of the protocol codes, generated from the X-macro lists of candy.h. A code is looked up with one bounds
+ * check and two table reads instead of a chain of comparisons at every call site. The values of a list index a byte
+ * table that holds the position of the name + 1, so the sparse item codes cost a byte per value and a pointer per
+ * name. Nothing here depends on ESP-IDF, the protocol decoder test/host/ssm_decode.c builds this file as is.
+ */
+
+#include "candy.h"
+
+#define CANDY_POS(name, value, str) name##_POS,
+#define CANDY_INDEX(name, value, str) [value] = name##_POS + 1,
+#define CANDY_NAME(name, value, str) [name##_POS] = str,
+
+// Define const char * fn(int code) returning the string of code in list, or unknown
+#define CANDY_NAME_TABLE(list, fn, unknown)                                          \
+	enum { list(CANDY_POS) };                                                        \
+	static const uint8_t fn##_index[] = { list(CANDY_INDEX) };                       \
+	static const char * const fn##_names[] = { list(CANDY_NAME) };                   \
+	const char * fn(int code) {                                                      \
+		if (code < 0 || code >= (int) sizeof(fn##_index) || fn##_index[code] == 0) { \
+			return unknown;                                                          \
+		}                                                                            \
+		return fn##_names[fn##_index[code] - 1];                                     \
+	}
+
+CANDY_NAME_TABLE(SSM_PRODUCT_TYPE_LIST, candy_product_type_str, "Unknown Model")
+CANDY_NAME_TABLE(SSM_STATUS_LIST, candy_status_str, "status_error")
+CANDY_NAME_TABLE(SSM_OP_CODE_LIST, candy_op_code_str, "unknown")
+CANDY_NAME_TABLE(SSM_ITEM_CODE_LIST, candy_item_code_str, "UNKNOWN_ITEM_CODE")
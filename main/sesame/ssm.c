@@ -2,24 +2,81 @@
 #include "blecent.h"
 #include "c_ccm.h"
 #include "esp_central.h"
+#include "mqtt_outbox.h"
 #include "mqtt_section.h"
-#include "nvs_flash.h"
+#include "ssm_boot.h"
 #include "ssm_cmd.h"
+#include "ssm_conn.h"
+#include "ssm_crypto.h"
+#include "ssm_log.h"
+#include "ssm_nvs.h"
+#include "ssm_rssi.h"
+#include "ssm_telemetry.h"
+#include "ssm_timer.h"
 
 static const char * TAG = "ssm.c";
 
 static uint8_t additional_data[] = { 0x00 };
 
-static double battery_vol[] = {5.85, 5.82, 5.79, 5.76, 5.73, 5.70, 5.65, 5.60, 5.55, 5.50, 5.40, 5.20, 5.10, 5.0, 4.8, 4.6}; // 20240526 by JS
+typedef struct {
+	uint16_t mv;
+	uint8_t pct;
+} battery_point_t;
+
+typedef struct {
+	const battery_point_t * points; // descending voltage
+	uint8_t cnt;
+} battery_curve_t;
+
+#define BATTERY_CURVE(points) { points, sizeof(points) / sizeof(points[0]) }
+
+static const battery_point_t battery_20240526[] = { // 20240526 by JS
+	{ 5850, 100 }, { 5820, 95 }, { 5790, 90 }, { 5760, 85 }, { 5730, 80 }, { 5700, 70 }, { 5650, 60 }, { 5600, 50 },
+	{ 5550, 40 }, { 5500, 32 }, { 5400, 21 }, { 5200, 13 }, { 5100, 10 }, { 5000, 7 }, { 4800, 3 }, { 4600, 0 },
+};
+
+static const battery_curve_t battery_curve_20240526 = BATTERY_CURVE(battery_20240526);
+
+// battery curve of product_type. Only the 20240526 curve is measured so far, a product with its own curve gets a case here
+static const battery_curve_t * battery_curve_for(candy_product_type product_type) {
+	switch (product_type) {
+	case SESAME_5:
+	case SESAME_5_PRO:
+	case SESAME_BIKE_2:
+	case SESAME_TOUCH:
+	case SESAME_TOUCH_PRO:
+	default:
+		return &battery_curve_20240526;
+	}
+}
 
-static double battery_pct[] = {100.0, 95.0, 90.0, 85.0, 80.0, 70.0, 60.0, 50.0, 40.0, 32.0, 21.0, 13.0, 10.0, 7.0, 3.0, 0.0}; // 20240526 by JS
+// battery percentage from the mech status battery, 2 mV per unit, interpolated between the points of the curve
+static uint8_t battery_percentage(candy_product_type product_type, uint16_t battery) {
+	const battery_curve_t * c = battery_curve_for(product_type);
+	const battery_point_t * curve = c->points;
+	int cnt = c->cnt;
+	uint32_t mv = (uint32_t) battery * 2;
+	if (mv >= curve[0].mv) {
+		return curve[0].pct;
+	}
+	for (int n = 1; n < cnt; n++) { // descending voltage
+		if (mv >= curve[n].mv) {
+			const battery_point_t * hi = &curve[n - 1];
+			const battery_point_t * lo = &curve[n];
+			return lo->pct + ((mv - lo->mv) * (hi->pct - lo->pct) + (hi->mv - lo->mv) / 2) / (hi->mv - lo->mv); // rounded
+		}
+	}
+	return curve[cnt - 1].pct;
+}
+
+double ssm_battery_percentage(const sesame * ssm) {
+	return ssm->battery_percentage;
+}
 
 uint8_t cnt_ssms = 0, cnt_unregistered_ssms = 0, real_num_ssms = 0;
 
 struct ssm_env_tag * p_ssms_env = NULL;
 
-struct timeval tv_start, tv_1min;
-
 int hex2dec(char hex_letter) {
 	int v = 0;
 	switch (hex_letter) {
@@ -142,142 +199,13 @@ void gen_qr_code_txt(sesame * ssm, char * qr) {
 	}
 }
 
-int timer_1min(void) {
-	struct timeval tv_now;
-	gettimeofday(&tv_now, NULL); // get current time
-	int diff = tv_now.tv_sec - tv_1min.tv_sec;
-	if (diff >= 60) {
-		gettimeofday(&tv_1min, NULL); // restart timer
-		return 1;
-	} else {
-		return 0;
-	}
-}
-
-void start_timer(void) {
-	gettimeofday(&tv_start, NULL); // loop start timer
-}
-
-int loop_timeout(void) {
-	struct timeval tv_now;
-	gettimeofday(&tv_now, NULL); // get current time
-	int diff = tv_now.tv_sec - tv_start.tv_sec;
-	return ((diff > CONFIG_ESP_TASK_WDT_TIMEOUT_S - 3 || diff < 0)); // timeout 3 secs later or time variable wrap around
-}
-
 int wait_for_status_update(sesame * ssm, uint8_t timeout_s) {
-	uint8_t n_max = timeout_s * 10;
-	int succeed = 0;
-	for (int n = 0; n < n_max; n++) {
-		if (ssm->update_status) {
-			ESP_LOGI(TAG, "%s received status update", SSM_PRODUCT_TYPE_STR(ssm->product_type));
-			succeed = 1;
-			break;
-		} else if (n == n_max - 1) { // timeout
-			ESP_LOGW(TAG, "%s wait status timeout", SSM_PRODUCT_TYPE_STR(ssm->product_type));
-		} else {
-			vTaskDelay(100 / portTICK_PERIOD_MS);
-		}
-	}
-	return succeed;
-}
-
-int ssm_read_nvs(sesame * ssm) {
-	nvs_handle_t my_handle;
-	esp_err_t err;
-	size_t len = 0;
-	uint8_t found = 0;
-	uint8_t addr[6];
-
-	// generate topic from MAC address as NVS name. The format is s2mooxxooxxooxx
-	memset(ssm->topic, 0, sizeof(ssm->topic));
-	int cnt = 0;
-	cnt += sprintf(ssm->topic + cnt, "s2m");
-	for (int n = 0; n < 6; n++) {
-		cnt += sprintf(ssm->topic + cnt, "%02x", ssm->addr[n]);
-	}
-
-	err = nvs_open(ssm->topic, NVS_READONLY, &my_handle);
-	if (err == ESP_OK) {
-		len = sizeof(ssm->addr);
-		err = nvs_get_blob(my_handle, "addr", addr, &len);
-		if (err == ESP_OK && memcmp(addr, ssm->addr, 6) == 0) { // double check if the address is the same
-			found = 1;
-			len = sizeof(ssm->device_uuid);
-			err = nvs_get_blob(my_handle, "device_uuid", ssm->device_uuid, &len);
-			len = sizeof(ssm->public_key);
-			err = nvs_get_blob(my_handle, "public_key", ssm->public_key, &len);
-			len = sizeof(ssm->device_secret);
-			err = nvs_get_blob(my_handle, "device_secret", ssm->device_secret, &len);
-			len = sizeof(ssm->cipher);
-			err = nvs_get_blob(my_handle, "cipher", (void *) (&ssm->cipher), &len);
-			len = sizeof(ssm->mech_status);
-			err = nvs_get_blob(my_handle, "mech_status", (void *) (&ssm->mech_status), &len);
-			len = sizeof(ssm->topic);
-			err = nvs_get_u16(my_handle, "c_offset", &ssm->c_offset);
-			err = nvs_get_u8(my_handle, "conn_id", &ssm->conn_id);
-			if (err != ESP_OK) {
-				ESP_LOGE(TAG, "NVS read error");
-			}
-		}
-	}
-	// NVS close
-	nvs_close(my_handle);
-
-	if (found) {
-		ESP_LOGI(TAG, "NVS read done");
-	} else {
-		ESP_LOGW(TAG, "NVS read failed");
-	}
-	return found;
-}
-
-int ssm_save_nvs(sesame * ssm) {
-	nvs_handle_t my_handle;
-	esp_err_t err;
-	int save_done = 0;
-
-	// generate topic from MAC address as NVS name. The format is s2mooxxooxxooxx
-	memset(ssm->topic, 0, sizeof(ssm->topic));
-	int cnt = 0;
-	cnt += sprintf(ssm->topic + cnt, "s2m");
-	for (int n = 0; n < 6; n++) {
-		cnt += sprintf(ssm->topic + cnt, "%02x", ssm->addr[n]);
-	}
-	err = nvs_open(ssm->topic, NVS_READWRITE, &my_handle);
-	if (err != ESP_OK) {
-		ESP_LOGE(TAG, "NVS OPEN error");
-	} else {
-		// NVS write
-		err = nvs_set_blob(my_handle, "device_uuid", ssm->device_uuid, sizeof(ssm->device_uuid));
-		err = nvs_set_blob(my_handle, "public_key", ssm->public_key, sizeof(ssm->public_key));
-		err = nvs_set_blob(my_handle, "device_secret", ssm->device_secret, sizeof(ssm->device_secret));
-		err = nvs_set_blob(my_handle, "addr", ssm->addr, sizeof(ssm->addr));
-		err = nvs_set_blob(my_handle, "cipher", (const void *) (&ssm->cipher), sizeof(ssm->cipher));
-		err = nvs_set_blob(my_handle, "mech_status", (const void *) (&ssm->mech_status), sizeof(ssm->mech_status));
-		err = nvs_set_u16(my_handle, "c_offset", ssm->c_offset);
-		err = nvs_set_u8(my_handle, "conn_id", ssm->conn_id);
-		if (err != ESP_OK) {
-			ESP_LOGE(TAG, "NVS write error");
-		} else {
-			// NVS commit
-			err = nvs_commit(my_handle);
-			if (err == ESP_OK) {
-				save_done = 1;
-			} else {
-				ESP_LOGE(TAG, "NVS commit error");
-			}
-		}
-	}
-	// NVS close
-	nvs_close(my_handle);
-
-	if (save_done) {
-		ESP_LOGI(TAG, "NVS save done");
-	} else {
-		ESP_LOGW(TAG, "NVS save failed");
+	if (ssm_conn_wait(ssm, SSM_CONN_EVENT_STATUS, timeout_s * 1000)) { // signaled by ssm_parse_publish()
+		ESP_LOGI(TAG, "%s received status update", SSM_PRODUCT_TYPE_STR(ssm->product_type));
+		return 1;
 	}
-	return save_done;
+	ESP_LOGW(TAG, "%s wait status timeout", SSM_PRODUCT_TYPE_STR(ssm->product_type));
+	return 0;
 }
 
 static void ssm_initial_handle(sesame * ssm, uint8_t cmd_it_code) {
@@ -302,32 +230,22 @@ static void ssm_parse_publish(sesame * ssm, uint8_t cmd_it_code) {
 		break;
 	case SSM_ITEM_CODE_MECH_STATUS:
 		memcpy((void *) &(ssm->mech_status), ssm->b_buf, 7);
-		ESP_LOGI(TAG, "%s:", SSM_PRODUCT_TYPE_STR(ssm->product_type));
-		ESP_LOGI(TAG, "battery = %d", ssm->mech_status.battery);
-		ESP_LOGI(TAG, "target = %d", ssm->mech_status.target);
-		ESP_LOGI(TAG, "position = %d", ssm->mech_status.position);
-		ESP_LOGI(TAG, "is_clutch_failed = %d", ssm->mech_status.is_clutch_failed);
-		ESP_LOGI(TAG, "is_lock_range = %d", ssm->mech_status.is_lock_range);
-		ESP_LOGI(TAG, "is_unlock_range = %d", ssm->mech_status.is_unlock_range);
-		ESP_LOGI(TAG, "is_critical = %d", ssm->mech_status.is_critical);
-		ESP_LOGI(TAG, "is_stop = %d", ssm->mech_status.is_stop);
-		ESP_LOGI(TAG, "is_low_battery = %d", ssm->mech_status.is_low_battery);
-		ESP_LOGI(TAG, "is_clockwise = %d", ssm->mech_status.is_clockwise);
+		SSM_LOG(SSM_EV_MECH_STATUS, ssm->mech_status.battery, ssm->mech_status.target, ssm->mech_status.position, ssm->b_buf[6]); // b_buf[6]: the is_* flags, bit 0 is_clutch_failed
 		device_status_t lockStatus = ssm->mech_status.is_lock_range ? SSM_LOCKED : (ssm->mech_status.is_unlock_range ? SSM_UNLOCKED : SSM_MOVED);
+		uint8_t state_changed = (ssm->device_status != lockStatus);
 		ssm->device_status = lockStatus;
 		ssm->update_status = 1;
 
-		// calculate battery percentage from voltage
-		ssm->battery_percentage = 0.;
-		double voltage = ssm->mech_status.battery * 2/1000.;
-		for (int i_bat = 0; i_bat < 16; i_bat++) {
-			if (voltage > battery_vol[i_bat]) {
-				ssm->battery_percentage = battery_pct[i_bat];
-				break;
-			}
+		if (ssm->mech_status.battery != ssm->battery_raw) { // the voltage changes much less often than the position
+			ssm->battery_raw = ssm->mech_status.battery;
+			ssm->battery_percentage = battery_percentage(ssm->product_type, ssm->battery_raw);
 		}
 
-		p_ssms_env->ssm_cb__(ssm); // callback: ssm_action_handle
+		ssm_nvs_stage(ssm); // committed with the next deferred NVS commit
+		if (!mqtt_starting() && ssm_telemetry_status(ssm, state_changed)) { // else published with the latest status by mqtt_sync_devices() once the broker is ready, or after the minimum interval
+			p_ssms_env->ssm_cb__(ssm); // callback: ssm_action_handle
+		}
+		ssm_conn_notify(ssm, SSM_CONN_EVENT_STATUS); // wake up wait_for_status_update()
 		break;
 	default:
 		break;
@@ -344,6 +262,7 @@ static void ssm_parse_response(sesame * ssm, uint8_t cmd_it_code) {
 	case SSM_ITEM_CODE_LOGIN:
 		ESP_LOGI(TAG, "[%d][%s][login][ok]", ssm->conn_id, SSM_PRODUCT_TYPE_STR(ssm->product_type));
 		ssm->device_status = SSM_LOGGIN;
+		ssm_conn_advance(ssm, SSM_CONN_READY); // sends the queued command
 		break;
 	case SSM_ITEM_CODE_HISTORY:
 		ESP_LOGI(TAG, "[%d][%s][hisdataLength: %d]", ssm->conn_id, SSM_PRODUCT_TYPE_STR(ssm->product_type), ssm->c_offset);
@@ -395,7 +314,7 @@ void ssm_ble_receiver(sesame * ssm, const uint8_t * p_data, uint16_t len) {
 	uint8_t cmd_it_code = ssm->b_buf[1];
 	ssm->c_offset = ssm->c_offset - 2;
 	memcpy(ssm->b_buf, ssm->b_buf + 2, ssm->c_offset);
-	ESP_LOGI(TAG, "[%s][say][%d][%s][%s]", SSM_PRODUCT_TYPE_STR(ssm->product_type), ssm->conn_id, SSM_OP_CODE_STR(cmd_op_code), SSM_ITEM_CODE_STR(cmd_it_code));
+	SSM_LOG(SSM_EV_BLE_RX, ssm->product_type, ssm->conn_id, cmd_op_code, cmd_it_code);
 
 	if (cmd_op_code == SSM_OP_CODE_PUBLISH) {
 		ssm_parse_publish(ssm, cmd_it_code);
@@ -406,7 +325,7 @@ void ssm_ble_receiver(sesame * ssm, const uint8_t * p_data, uint16_t len) {
 }
 
 void talk_to_ssm(sesame * ssm, uint8_t parsing_type) {
-	ESP_LOGI(TAG, "[esp32][say][%d][%s]", ssm->conn_id, SSM_ITEM_CODE_STR(ssm->b_buf[0]));
+	SSM_LOG(SSM_EV_BLE_TX, ssm->conn_id, ssm->b_buf[0], 0, 0);
 	if (parsing_type == SSM_SEG_PARSING_TYPE_CIPHERTEXT) {
 		aes_ccm_encrypt_and_tag(ssm->cipher.token, (const unsigned char *) &ssm->cipher.encrypt, 13, additional_data, 1, ssm->b_buf, ssm->c_offset, ssm->b_buf, ssm->b_buf + ssm->c_offset, CCM_TAG_LENGTH);
 		ssm->cipher.encrypt.count++;
@@ -438,6 +357,7 @@ void talk_to_ssm(sesame * ssm, uint8_t parsing_type) {
 }
 
 void ssm_mem_deinit(void) {
+	ssm_nvs_flush();
 	free(p_ssms_env);
 }
 
@@ -469,5 +389,13 @@ void ssm_init(ssm_action ssm_action_cb) {
 		(p_ssms_env + n)->ssm.rssi_changed = 0;					   // 20240605 add by JS
 		memset((p_ssms_env + n)->ssm.topic, 0, sizeof((p_ssms_env + n)->ssm.topic));
 	}
+	ssm_nvs_init();
+	ssm_conn_init();
+	ssm_nvs_load_registry(); // registered devices are looked up in RAM while scanning
+	ssm_boot_mark(SSM_BOOT_REGISTRY);
+	ssm_timer_init();
+	mqtt_outbox_init(); // device values are kept from the first status on, the broker may come up later
+	ssm_rssi_init();
+	ssm_crypto_init(); // the ephemeral key pair for the next registration is ready before any device is found
 	ESP_LOGI(TAG, "[ssms_init][SUCCESS]");
 }
\ No newline at end of file
@@ -0,0 +1,124 @@
+/*
+ * Boot profile. Each startup phase records the first time it is reached on the monotonic clock, and the timestamps
+ * are published as one JSON object when the broker is ready and again after each later phase, so the time between
+ * app_main() and the last login can be split into NVS, Wi-Fi, MQTT and BLE.
+ *
+ * The broker of the persistent MQTT session is kept in NVS. On a warm start mqtt_start() connects the persistent
+ * session directly instead of a throwaway clean session first.
+ */
+
+#include "ssm_boot.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_system.h"
+#include "mqtt_section.h"
+#include "nvs.h"
+#include "ssm_nvs.h"
+#include "ssm_timer.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char * TAG = "ssm_boot.c";
+
+#define SSM_BOOT_NVS_NAME "ssm_boot" // not s2m..., the registry skips it
+#define SSM_BOOT_NVS_BROKER "broker"
+#define SSM_BOOT_PUBLISH_DELAY_MS 1000 // phases reached close together are published once
+
+static const char * ssm_boot_phase_str[SSM_BOOT_NUM] = {
+	[SSM_BOOT_APP_MAIN] = "app_main",
+	[SSM_BOOT_NVS] = "nvs",
+	[SSM_BOOT_REGISTRY] = "registry",
+	[SSM_BOOT_WIFI_START] = "wifi_start",
+	[SSM_BOOT_WIFI_IP] = "wifi_ip",
+	[SSM_BOOT_MQTT_CLEAN] = "mqtt_clean",
+	[SSM_BOOT_MQTT_READY] = "mqtt_ready",
+	[SSM_BOOT_BLE_INIT] = "ble_init",
+	[SSM_BOOT_BLE_SYNC] = "ble_sync",
+	[SSM_BOOT_BLE_LINK] = "ble_link",
+	[SSM_BOOT_BLE_LOGIN] = "ble_login",
+	[SSM_BOOT_BLE_ALL] = "ble_all",
+};
+
+static int64_t t_phase_us[SSM_BOOT_NUM]; // 0 if not reached
+static uint8_t warm = 0;	   // this boot skipped the clean session
+static uint8_t warm_saved = 0; // NVS holds the current broker
+static uint8_t logged_in = 0; // bit per slot of p_ssms_env
+
+static void ssm_boot_publish(void * arg) {
+	char topic[48];
+	char payload[400];
+	uint8_t mac[6] = {};
+	esp_read_mac(mac, ESP_MAC_WIFI_STA);
+	snprintf(topic, sizeof(topic), "homeassistant/esp%02x%02x%02x%02x%02x%02x/boot", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+	int len = snprintf(payload, sizeof(payload), "{\"warm\":%u,\"reset_reason\":%d,\"ms\":{", warm, (int) esp_reset_reason());
+	const char * sep = "";
+	for (int n = 0; n < SSM_BOOT_NUM && len < sizeof(payload); n++) {
+		if (t_phase_us[n]) {
+			len += snprintf(payload + len, sizeof(payload) - len, "%s\"%s\":%ld", sep, ssm_boot_phase_str[n], (long) (t_phase_us[n] / 1000));
+			sep = ",";
+		}
+	}
+	if (len < sizeof(payload)) {
+		snprintf(payload + len, sizeof(payload) - len, "}}");
+	}
+	ESP_LOGI(TAG, "%s", payload);
+	mqtt_publish(topic, payload, MQTT_CLASS_TELEMETRY);
+}
+
+void ssm_boot_mark(ssm_boot_phase_t phase) {
+	if (phase >= SSM_BOOT_NUM || t_phase_us[phase]) {
+		return;
+	}
+	t_phase_us[phase] = ssm_timer_now_us();
+	ESP_LOGI(TAG, "[%s] %ld ms", ssm_boot_phase_str[phase], (long) (t_phase_us[phase] / 1000));
+	if (t_phase_us[SSM_BOOT_MQTT_READY]) {
+		ssm_timer_start(ssm_boot_publish, NULL, SSM_BOOT_PUBLISH_DELAY_MS, 0); // re-armed by the next phase
+	}
+}
+
+void ssm_boot_device_ready(sesame * ssm) {
+	int idx = (struct ssm_env_tag *) ssm - p_ssms_env; // sesame is the first member of ssm_env_tag
+	uint8_t addrs[SSM_MAX_NUM][6];
+	if (idx < 0 || idx >= SSM_MAX_NUM) {
+		return;
+	}
+	ssm_boot_mark(SSM_BOOT_BLE_LOGIN);
+	logged_in |= 1u << idx;
+	if (__builtin_popcount(logged_in) >= ssm_nvs_registry_addrs(addrs, SSM_MAX_NUM)) {
+		ssm_boot_mark(SSM_BOOT_BLE_ALL);
+	}
+}
+
+int ssm_boot_warm(const char * broker) {
+	nvs_handle_t my_handle;
+	char saved[sizeof(config_broker_url)] = "";
+	size_t len = sizeof(saved);
+	if (nvs_open(SSM_BOOT_NVS_NAME, NVS_READONLY, &my_handle) != ESP_OK) {
+		return 0;
+	}
+	esp_err_t err = nvs_get_str(my_handle, SSM_BOOT_NVS_BROKER, saved, &len);
+	nvs_close(my_handle);
+	warm = warm_saved = (err == ESP_OK && strcmp(saved, broker) == 0); // a new broker doesn't know our session
+	return warm;
+}
+
+void ssm_boot_save_warm(const char * broker) {
+	nvs_handle_t my_handle;
+	if ((broker != NULL) == warm_saved) { // NVS is up to date
+		return;
+	}
+	if (nvs_open(SSM_BOOT_NVS_NAME, NVS_READWRITE, &my_handle) != ESP_OK) {
+		ESP_LOGE(TAG, "NVS OPEN error");
+		return;
+	}
+	esp_err_t err = (broker != NULL) ? nvs_set_str(my_handle, SSM_BOOT_NVS_BROKER, broker) : nvs_erase_key(my_handle, SSM_BOOT_NVS_BROKER);
+	if (err == ESP_OK || err == ESP_ERR_NVS_NOT_FOUND) {
+		err = nvs_commit(my_handle);
+	}
+	nvs_close(my_handle);
+	if (err == ESP_OK) {
+		warm_saved = (broker != NULL);
+	} else {
+		ESP_LOGW(TAG, "saving the warm start state failed");
+	}
+}
@@ -1,43 +1,76 @@
 #include "ssm_cmd.h"
 #include "aes-cbc-cmac.h"
 #include "blecent.h"
+#include "ssm_conn.h"
+#include "ssm_crypto.h"
 #include "esp_log.h"
-#include "esp_random.h"
-#include "uECC.h"
 #include <string.h>
 
 static const char * TAG = "ssm_cmd.c";
 static uint8_t tag_esp32[] = { 'S', 'E', 'S', 'A', 'M', 'E', ' ', 'E', 'S', 'P', '3', '2' };
-static uint8_t ecc_private_esp32[32];
+typedef struct {
+	uint8_t public_key[64];
+	uint8_t private_key[32];
+	uint8_t secret[32];
+} ssm_reg_keys_t;
 
-static int crypto_backend_micro_ecc_rng_callback(uint8_t * dest, unsigned size) {
-	esp_fill_random(dest, (size_t) size);
-	return 1;
+static ssm_reg_keys_t reg_keys[SSM_MAX_NUM]; // ephemeral keys of a registration, one set per device slot
+
+static ssm_reg_keys_t * ssm_reg_keys(sesame * ssm) {
+	int idx = (struct ssm_env_tag *) ssm - p_ssms_env; // sesame is the first member of ssm_env_tag
+	if (idx < 0 || idx >= SSM_MAX_NUM) {
+		return NULL;
+	}
+	return &reg_keys[idx];
 }
 
-void send_reg_cmd_to_ssm(sesame * ssm) {
-	ESP_LOGW(TAG, "[esp32->%s][register]", SSM_PRODUCT_TYPE_STR(ssm->product_type));
-	uECC_set_rng(crypto_backend_micro_ecc_rng_callback);
-	uint8_t ecc_public_esp32[64];
-	uECC_make_key_lit(ecc_public_esp32, ecc_private_esp32, uECC_secp256r1());
-	ssm->c_offset = sizeof(ecc_public_esp32) + 1;
+static void ssm_reg_fail(sesame * ssm, ssm_reg_keys_t * keys) { // the device waits for a key we can't send, start over with a new connection
+	ESP_LOGE(TAG, "[esp32->%s][register][FAIL]", SSM_PRODUCT_TYPE_STR(ssm->product_type));
+	if (keys != NULL) {
+		memset(keys, 0, sizeof(ssm_reg_keys_t));
+	}
+	ble_gap_terminate(ssm->conn_id, BLE_ERR_REM_USER_CONN_TERM);
+}
+
+static void send_reg_cmd_key_done(sesame * ssm, int ok) {
+	ssm_reg_keys_t * keys = ssm_reg_keys(ssm);
+	if (!ok || keys == NULL) {
+		ssm_reg_fail(ssm, keys);
+		return;
+	}
+	ssm->c_offset = sizeof(keys->public_key) + 1;
 	ssm->b_buf[0] = SSM_ITEM_CODE_REGISTRATION;
-	memcpy(ssm->b_buf + 1, ecc_public_esp32, sizeof(ecc_public_esp32));
+	memcpy(ssm->b_buf + 1, keys->public_key, sizeof(keys->public_key));
 	talk_to_ssm(ssm, SSM_SEG_PARSING_TYPE_PLAINTEXT);
 }
 
-void handle_reg_data_from_ssm(sesame * ssm) {
-	ESP_LOGW(TAG, "[esp32<-%s][register]", SSM_PRODUCT_TYPE_STR(ssm->product_type));
-	if (ssm->product_type == SESAME_5 || ssm->product_type == SESAME_5_PRO) { // Sesame5 or Sesame5 Pro Lock
-		memcpy(ssm->public_key, &ssm->b_buf[13], 64);
-	} else { // Sesame Touch
-		memcpy(ssm->public_key, &ssm->b_buf[0], 64);
+void send_reg_cmd_to_ssm(sesame * ssm) {
+	ESP_LOGW(TAG, "[esp32->%s][register]", SSM_PRODUCT_TYPE_STR(ssm->product_type));
+	ssm_reg_keys_t * keys = ssm_reg_keys(ssm);
+	if (keys == NULL) {
+		ssm_reg_fail(ssm, NULL);
+		return;
+	}
+	if (ssm_crypto_take_key(keys->public_key, keys->private_key)) { // pre-generated at boot
+		send_reg_cmd_key_done(ssm, 1);
+		return;
 	}
-	uint8_t ecdh_secret_ssm[32];
-	uECC_shared_secret_lit(ssm->public_key, ecc_private_esp32, ecdh_secret_ssm, uECC_secp256r1());
-	memcpy(ssm->device_secret, ecdh_secret_ssm, 16);
+	if (!ssm_crypto_make_key(ssm, keys->public_key, keys->private_key, send_reg_cmd_key_done)) {
+		ssm_reg_fail(ssm, keys);
+	}
+}
+
+static void handle_reg_data_ecdh_done(sesame * ssm, int ok) {
+	ssm_reg_keys_t * keys = ssm_reg_keys(ssm);
+	if (!ok || keys == NULL) {
+		ssm_reg_fail(ssm, keys);
+		return;
+	}
+	memcpy(ssm->device_secret, keys->secret, 16);
+	memset(keys, 0, sizeof(ssm_reg_keys_t)); // the key pair is used once
 	// ESP_LOG_BUFFER_HEX("deviceSecret", ssm->device_secret, 16);
-	AES_CMAC(ssm->device_secret, (const unsigned char *) ssm->cipher.decrypt.random_code, 4, ssm->cipher.token);
+	AES_CMAC_SUBKEY(ssm->device_secret, ssm->cmac_subkey[0], ssm->cmac_subkey[1]);
+	ssm->cmac_subkey_valid = 1; // token is derived by send_login_cmd_to_ssm below
 	ssm->device_status = SSM_LOGGIN;
 	ssm_save_nvs(ssm); // save ssm configurations in NVS
 	ESP_LOGI(TAG, "%s NVS save done", SSM_PRODUCT_TYPE_STR(ssm->product_type));
@@ -47,13 +80,35 @@ void handle_reg_data_from_ssm(sesame * ssm) {
 	send_login_cmd_to_ssm(ssm);
 }
 
+void handle_reg_data_from_ssm(sesame * ssm) {
+	ESP_LOGW(TAG, "[esp32<-%s][register]", SSM_PRODUCT_TYPE_STR(ssm->product_type));
+	if (ssm->product_type == SESAME_5 || ssm->product_type == SESAME_5_PRO) { // Sesame5 or Sesame5 Pro Lock
+		memcpy(ssm->public_key, &ssm->b_buf[13], 64);
+	} else { // Sesame Touch
+		memcpy(ssm->public_key, &ssm->b_buf[0], 64);
+	}
+	ssm_reg_keys_t * keys = ssm_reg_keys(ssm);
+	if (keys == NULL) {
+		ssm_reg_fail(ssm, NULL);
+		return;
+	}
+	if (!ssm_crypto_shared_secret(ssm, ssm->public_key, keys->private_key, keys->secret, handle_reg_data_ecdh_done)) {
+		ssm_reg_fail(ssm, keys);
+	}
+}
+
 void send_login_cmd_to_ssm(sesame * ssm) {
 	ESP_LOGW(TAG, "[esp32->%s][login]", SSM_PRODUCT_TYPE_STR(ssm->product_type));
 	ssm->b_buf[0] = SSM_ITEM_CODE_LOGIN;
-	AES_CMAC(ssm->device_secret, (const unsigned char *) ssm->cipher.decrypt.random_code, 4, ssm->cipher.token);
+	if (!ssm->cmac_subkey_valid) { // normally derived once when the registry is loaded
+		AES_CMAC_SUBKEY(ssm->device_secret, ssm->cmac_subkey[0], ssm->cmac_subkey[1]);
+		ssm->cmac_subkey_valid = 1;
+	}
+	AES_CMAC_PRECOMPUTED(ssm->device_secret, ssm->cmac_subkey[0], ssm->cmac_subkey[1], (const unsigned char *) ssm->cipher.decrypt.random_code, 4, ssm->cipher.token);
 	memcpy(&ssm->b_buf[1], ssm->cipher.token, 4);
 	ssm->c_offset = 5;
 	talk_to_ssm(ssm, SSM_SEG_PARSING_TYPE_PLAINTEXT);
+	ssm_conn_advance(ssm, SSM_CONN_LOGIN);
 
 	// one more registered device login successfully
 	if (ssm->cnt_discovery == 0) {
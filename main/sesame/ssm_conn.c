@@ -0,0 +1,157 @@
+/*
+ * Connection state machine. A connection goes through link, notify enable, initial, login and ready, and each step
+ * is started as soon as the previous one is done. A user command for a disconnected device, e.g. a Sesame Touch,
+ * is queued and sent right after the login response instead of waiting for the following status publish.
+ * The time from ble_gap_connect() to command ready is logged for every connection. Waiters for a status update or a
+ * queued command block on a per-device event group instead of polling.
+ */
+
+#include "ssm_conn.h"
+#include "blecent.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "ssm_boot.h"
+
+static const char * TAG = "ssm_conn.c";
+
+static const char * ssm_conn_phase_str[] = { "idle", "link", "notify", "initial", "login", "ready" };
+
+static ssm_conn_t conns[SSM_MAX_NUM];
+static SemaphoreHandle_t conn_lock = NULL; // guards the queued command, created by ssm_conn_init()
+
+void ssm_conn_init(void) {
+	if (conn_lock == NULL) {
+		conn_lock = xSemaphoreCreateMutex();
+	}
+	for (int n = 0; n < SSM_MAX_NUM; n++) {
+		if (conns[n].events == NULL) {
+			conns[n].events = xEventGroupCreate();
+		}
+	}
+}
+
+static void ssm_conn_lock(void) {
+	xSemaphoreTake(conn_lock, portMAX_DELAY);
+}
+
+static void ssm_conn_unlock(void) {
+	xSemaphoreGive(conn_lock);
+}
+
+ssm_conn_t * ssm_conn_get(sesame * ssm) {
+	int idx = (struct ssm_env_tag *) ssm - p_ssms_env; // sesame is the first member of ssm_env_tag
+	if (p_ssms_env == NULL || idx < 0 || idx >= SSM_MAX_NUM) {
+		return NULL;
+	}
+	return &conns[idx];
+}
+
+void ssm_conn_start(sesame * ssm) {
+	ssm_conn_t * c = ssm_conn_get(ssm);
+	if (c == NULL) {
+		return;
+	}
+	c->t_start_us = esp_timer_get_time();
+	c->phase = SSM_CONN_LINK;
+}
+
+void ssm_conn_advance(sesame * ssm, ssm_conn_phase_t phase) {
+	ssm_conn_t * c = ssm_conn_get(ssm);
+	if (c == NULL) {
+		return;
+	}
+	int32_t elapsed_ms = (int32_t) ((esp_timer_get_time() - c->t_start_us) / 1000);
+	c->phase = phase;
+	ESP_LOGI(TAG, "[%s][%s] %ld ms", SSM_PRODUCT_TYPE_STR(ssm->product_type), ssm_conn_phase_str[phase], (long) elapsed_ms);
+	if (phase != SSM_CONN_READY) {
+		return;
+	}
+	c->ready_ms = elapsed_ms;
+	ssm_sup_ble_link_up(ssm);
+	ssm_boot_device_ready(ssm);
+	ESP_LOGW(TAG, "%s command ready %ld ms after connect", SSM_PRODUCT_TYPE_STR(ssm->product_type), (long) elapsed_ms);
+
+	ssm_conn_lock();
+	ssm_conn_cmd cmd = c->cmd;
+	sesame * peer = c->cmd_peer;
+	c->cmd = NULL;
+	ssm_conn_unlock();
+	if (cmd != NULL) {
+		cmd(ssm, peer);
+		c->cmd_done = 1;
+		ssm_conn_notify(ssm, SSM_CONN_EVENT_CMD_DONE);
+	}
+}
+
+void ssm_conn_reset(sesame * ssm) {
+	ssm_conn_t * c = ssm_conn_get(ssm);
+	if (c == NULL) {
+		return;
+	}
+	c->phase = SSM_CONN_IDLE;
+	ssm_conn_lock();
+	if (c->cmd != NULL) {
+		ESP_LOGW(TAG, "%s disconnected, queued command dropped", SSM_PRODUCT_TYPE_STR(ssm->product_type));
+		c->cmd = NULL;
+	}
+	ssm_conn_unlock();
+}
+
+void ssm_conn_notify(sesame * ssm, EventBits_t bits) {
+	ssm_conn_t * c = ssm_conn_get(ssm);
+	if (c == NULL || c->events == NULL) {
+		return;
+	}
+	xEventGroupSetBits(c->events, bits);
+}
+
+void ssm_conn_clear(sesame * ssm, EventBits_t bits) {
+	ssm_conn_t * c = ssm_conn_get(ssm);
+	if (c == NULL || c->events == NULL) {
+		return;
+	}
+	xEventGroupClearBits(c->events, bits);
+}
+
+int ssm_conn_wait(sesame * ssm, EventBits_t bits, uint32_t timeout_ms) {
+	ssm_conn_t * c = ssm_conn_get(ssm);
+	if (c == NULL || c->events == NULL) {
+		return 0;
+	}
+	return (xEventGroupWaitBits(c->events, bits, pdTRUE, pdFALSE, pdMS_TO_TICKS(timeout_ms)) & bits) != 0;
+}
+
+int ssm_conn_run(sesame * ssm, ssm_conn_cmd cmd, sesame * peer, uint8_t timeout_s) {
+	ssm_conn_t * c = ssm_conn_get(ssm);
+	if (c == NULL) {
+		return 0;
+	}
+	ssm_conn_clear(ssm, SSM_CONN_EVENT_CMD_DONE);
+	ssm_conn_lock();
+	if (c->phase == SSM_CONN_READY && ssm->device_status >= SSM_LOGGIN) { // connected already
+		ssm_conn_unlock();
+		cmd(ssm, peer);
+		return 1;
+	}
+	c->cmd = cmd;
+	c->cmd_peer = peer;
+	c->cmd_done = 0;
+	uint8_t idle = (c->phase == SSM_CONN_IDLE);
+	ssm_conn_unlock();
+	if (idle) { // a connection in progress picks up the command when it is ready
+		reconnect(ssm);
+	}
+
+	ssm_conn_wait(ssm, SSM_CONN_EVENT_CMD_DONE, timeout_s * 1000);
+	ssm_conn_lock();
+	int done = c->cmd_done;
+	if (!done && c->cmd == cmd) { // not sent, don't run it on a later connection
+		c->cmd = NULL;
+		ESP_LOGW(TAG, "%s command timeout", SSM_PRODUCT_TYPE_STR(ssm->product_type));
+	}
+	ssm_conn_unlock();
+	return done;
+}
@@ -0,0 +1,184 @@
+/*
+ * Crypto worker. P-256 key generation and ECDH take milliseconds, so they run in their own task instead of the
+ * NimBLE host task. The completion callback is posted back to the host task as an event of its default queue, so
+ * it may talk to the device like any other BLE handler. A job that can't be queued fails at once and is never run
+ * in the caller. One ephemeral key pair is generated ahead of time, so a registration can send its public key at once.
+ */
+
+#include "ssm_crypto.h"
+#include "esp_log.h"
+#include "esp_random.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "nimble/nimble_port.h"
+#include "uECC.h"
+#include <string.h>
+
+static const char * TAG = "ssm_crypto.c";
+
+#define SSM_CRYPTO_STACK_SIZE 4096
+#define SSM_CRYPTO_PRIORITY (tskIDLE_PRIORITY + 2) // below the NimBLE host task
+#define SSM_CRYPTO_QUEUE_LEN (SSM_MAX_NUM + 1) // one job per device and the refill, so a post never waits
+
+typedef enum {
+	SSM_CRYPTO_MAKE_KEY,
+	SSM_CRYPTO_SHARED_SECRET,
+	SSM_CRYPTO_REFILL, // pre-generate the next key pair
+} ssm_crypto_op_t;
+
+typedef struct {
+	struct ble_npl_event ev; // runs done in the NimBLE host task
+	sesame * ssm;
+	ssm_crypto_done done;
+	int ok;
+} ssm_crypto_result_t;
+
+typedef struct {
+	ssm_crypto_op_t op;
+	const uint8_t * public_key_in;
+	const uint8_t * private_key_in;
+	uint8_t * public_key_out;
+	uint8_t * private_key_out;
+	uint8_t * secret;
+	ssm_crypto_result_t * result; // NULL for SSM_CRYPTO_REFILL
+} ssm_crypto_job_t;
+
+static ssm_crypto_result_t results[SSM_MAX_NUM]; // one job at a time per device, registration makes a key and then the secret
+static uint8_t results_ready = 0;
+static QueueHandle_t crypto_queue = NULL;
+static SemaphoreHandle_t spare_lock = NULL;
+static uint8_t spare_public[64];
+static uint8_t spare_private[32];
+static uint8_t spare_ready = 0;
+
+static int crypto_backend_micro_ecc_rng_callback(uint8_t * dest, unsigned size) {
+	esp_fill_random(dest, (size_t) size);
+	return 1;
+}
+
+static void ssm_crypto_run(const ssm_crypto_job_t * job) {
+	int ok = 0;
+	switch (job->op) {
+	case SSM_CRYPTO_MAKE_KEY:
+		ok = uECC_make_key_lit(job->public_key_out, job->private_key_out, uECC_secp256r1());
+		break;
+	case SSM_CRYPTO_SHARED_SECRET:
+		ok = uECC_shared_secret_lit(job->public_key_in, job->private_key_in, job->secret, uECC_secp256r1());
+		break;
+	case SSM_CRYPTO_REFILL: {
+		uint8_t pub[64], priv[32];
+		if (uECC_make_key_lit(pub, priv, uECC_secp256r1())) {
+			xSemaphoreTake(spare_lock, portMAX_DELAY);
+			memcpy(spare_public, pub, sizeof(spare_public));
+			memcpy(spare_private, priv, sizeof(spare_private));
+			spare_ready = 1;
+			xSemaphoreGive(spare_lock);
+		}
+		memset(priv, 0, sizeof(priv));
+		return;
+	}
+	}
+	if (!ok) {
+		ESP_LOGE(TAG, "[crypto op %d][FAIL]", job->op);
+	}
+	if (job->result == NULL) {
+		return;
+	}
+	job->result->ok = ok;
+	ble_npl_eventq_put(nimble_port_get_dflt_eventq(), &job->result->ev);
+}
+
+static void ssm_crypto_done_ev(struct ble_npl_event * ev) {
+	ssm_crypto_result_t * r = (ssm_crypto_result_t *) ble_npl_event_get_arg(ev);
+	r->done(r->ssm, r->ok);
+}
+
+static void ssm_crypto_task(void * param) {
+	ssm_crypto_job_t job;
+	for (;;) {
+		if (xQueueReceive(crypto_queue, &job, portMAX_DELAY) == pdTRUE) {
+			ssm_crypto_run(&job);
+		}
+	}
+}
+
+// queue job for the worker, return 0 if it can't be run. The caller is the NimBLE host task, so it is never run in place
+static int ssm_crypto_post(ssm_crypto_job_t * job, sesame * ssm, ssm_crypto_done done) {
+	if (done != NULL) {
+		int idx = (struct ssm_env_tag *) ssm - p_ssms_env; // sesame is the first member of ssm_env_tag
+		if (!results_ready || idx < 0 || idx >= SSM_MAX_NUM) { // the result could not be posted back
+			ESP_LOGE(TAG, "[crypto op %d] no host event", job->op);
+			return 0;
+		}
+		job->result = &results[idx];
+		job->result->ssm = ssm;
+		job->result->done = done;
+	}
+	if (crypto_queue == NULL || xQueueSend(crypto_queue, job, 0) != pdTRUE) {
+		ESP_LOGE(TAG, "[crypto op %d] worker is not available", job->op);
+		return 0;
+	}
+	return 1;
+}
+
+void ssm_crypto_init(void) {
+	uECC_set_rng(crypto_backend_micro_ecc_rng_callback);
+	spare_lock = xSemaphoreCreateMutex();
+	crypto_queue = xQueueCreate(SSM_CRYPTO_QUEUE_LEN, sizeof(ssm_crypto_job_t));
+	if (spare_lock == NULL || crypto_queue == NULL || xTaskCreate(ssm_crypto_task, "ssm_crypto", SSM_CRYPTO_STACK_SIZE, NULL, SSM_CRYPTO_PRIORITY, NULL) != pdPASS) {
+		ESP_LOGE(TAG, "[ssm_crypto_init][FAIL]");
+		crypto_queue = NULL;
+		return;
+	}
+	ssm_crypto_job_t job = { .op = SSM_CRYPTO_REFILL };
+	ssm_crypto_post(&job, NULL, NULL);
+}
+
+void ssm_crypto_host_init(void) {
+	for (int n = 0; n < SSM_MAX_NUM; n++) {
+		ble_npl_event_init(&results[n].ev, ssm_crypto_done_ev, &results[n]);
+	}
+	results_ready = 1;
+}
+
+int ssm_crypto_take_key(uint8_t * public_key, uint8_t * private_key) {
+	int taken = 0;
+	if (spare_lock == NULL) {
+		return 0;
+	}
+	xSemaphoreTake(spare_lock, portMAX_DELAY);
+	if (spare_ready) {
+		memcpy(public_key, spare_public, sizeof(spare_public));
+		memcpy(private_key, spare_private, sizeof(spare_private));
+		memset(spare_private, 0, sizeof(spare_private)); // a key pair is used once
+		spare_ready = 0;
+		taken = 1;
+	}
+	xSemaphoreGive(spare_lock);
+	if (taken) {
+		ssm_crypto_job_t job = { .op = SSM_CRYPTO_REFILL };
+		ssm_crypto_post(&job, NULL, NULL); // if not queued, the next registration makes its key in the worker
+	}
+	return taken;
+}
+
+int ssm_crypto_make_key(sesame * ssm, uint8_t * public_key, uint8_t * private_key, ssm_crypto_done done) {
+	ssm_crypto_job_t job = {
+		.op = SSM_CRYPTO_MAKE_KEY,
+		.public_key_out = public_key,
+		.private_key_out = private_key,
+	};
+	return ssm_crypto_post(&job, ssm, done);
+}
+
+int ssm_crypto_shared_secret(sesame * ssm, const uint8_t * public_key, const uint8_t * private_key, uint8_t * secret, ssm_crypto_done done) {
+	ssm_crypto_job_t job = {
+		.op = SSM_CRYPTO_SHARED_SECRET,
+		.public_key_in = public_key,
+		.private_key_in = private_key,
+		.secret = secret,
+	};
+	return ssm_crypto_post(&job, ssm, done);
+}
@@ -0,0 +1,114 @@
+/*
+ * Binary event log of the hot paths. Each SSM_LOG() stores the time, the event id and four integer arguments in a
+ * RAM ring, the format string and the product, op and item names are only looked up by ssm_log_dump(). Receiving a
+ * notification or an MQTT message no longer formats strings and waits for the UART.
+ *
+ * A writer reserves its slot with one atomic increment, so the BLE host, MQTT and timer tasks log without a lock.
+ * The sequence number of a record is written last, the dump skips a record that was overwritten while it read it.
+ */
+
+#include "ssm_log.h"
+#include "candy.h"
+#include "esp_log.h"
+#include "ssm_timer.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char * TAG = "ssm_log.c";
+
+#define SSM_LOG_RING CONFIG_SSM_LOG_RING_SIZE
+_Static_assert((SSM_LOG_RING & (SSM_LOG_RING - 1)) == 0, "CONFIG_SSM_LOG_RING_SIZE must be a power of 2");
+
+typedef struct {
+	uint32_t seq;  // index of the record + 1, 0 while it is written
+	uint32_t t_ms; // ssm_timer_now_us() / 1024, wraps after 50 days
+	int32_t a[4];
+	uint8_t id;
+} ssm_log_rec_t;
+
+typedef struct {
+	const char * fmt;
+	uint8_t arg[4]; // ssm_log_arg_t
+} ssm_log_event_info_t;
+
+#define SSM_LOG_EVENT_INFO(id, level, fmt, t0, t1, t2, t3) [id] = { fmt, { SSM_LOG_ARG_##t0, SSM_LOG_ARG_##t1, SSM_LOG_ARG_##t2, SSM_LOG_ARG_##t3 } },
+static const ssm_log_event_info_t ssm_log_events[SSM_EV_NUM] = { SSM_LOG_EVENTS(SSM_LOG_EVENT_INFO) };
+
+static ssm_log_rec_t ssm_log_ring[SSM_LOG_RING];
+static uint32_t ssm_log_head = 0; // records written since boot
+
+static void ssm_log_print(const ssm_log_rec_t * r);
+
+void ssm_log_put(ssm_log_event_t id, int32_t a0, int32_t a1, int32_t a2, int32_t a3) {
+	uint32_t n = __atomic_fetch_add(&ssm_log_head, 1, __ATOMIC_RELAXED);
+	ssm_log_rec_t * r = &ssm_log_ring[n & (SSM_LOG_RING - 1)];
+	__atomic_store_n(&r->seq, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	r->t_ms = (uint32_t) (ssm_timer_now_us() >> 10); // a shift instead of a 64 bit division
+	r->a[0] = a0;
+	r->a[1] = a1;
+	r->a[2] = a2;
+	r->a[3] = a3;
+	r->id = (uint8_t) id;
+	__atomic_store_n(&r->seq, n + 1, __ATOMIC_RELEASE);
+#if CONFIG_SSM_LOG_ECHO
+	ssm_log_print(r);
+#endif
+}
+
+static void ssm_log_arg_str(char * s, size_t size, uint8_t type, int32_t v) {
+	switch (type) {
+	case SSM_LOG_ARG_INT:
+		snprintf(s, size, "%ld", (long) v);
+		break;
+	case SSM_LOG_ARG_HEX:
+		snprintf(s, size, "%02lx", (unsigned long) v);
+		break;
+	case SSM_LOG_ARG_PRODUCT:
+		snprintf(s, size, "%s", SSM_PRODUCT_TYPE_STR(v));
+		break;
+	case SSM_LOG_ARG_OP:
+		snprintf(s, size, "%s", SSM_OP_CODE_STR(v));
+		break;
+	case SSM_LOG_ARG_ITEM:
+		snprintf(s, size, "%s", SSM_ITEM_CODE_STR(v));
+		break;
+	default:
+		s[0] = '\0';
+		break;
+	}
+}
+
+static void ssm_log_print(const ssm_log_rec_t * r) {
+	char arg[4][40];
+	if (r->id >= SSM_EV_NUM) {
+		return;
+	}
+	const ssm_log_event_info_t * ev = &ssm_log_events[r->id];
+	for (int k = 0; k < 4; k++) {
+		ssm_log_arg_str(arg[k], sizeof(arg[k]), ev->arg[k], r->a[k]);
+	}
+	uint64_t ms = (uint64_t) r->t_ms * 1024 / 1000;
+	printf("(%lu.%03lu) ", (unsigned long) (ms / 1000), (unsigned long) (ms % 1000));
+	printf(ev->fmt, arg[0], arg[1], arg[2], arg[3]);
+	printf("\r\n");
+}
+
+void ssm_log_dump(void) {
+	uint32_t head = __atomic_load_n(&ssm_log_head, __ATOMIC_ACQUIRE);
+	uint32_t n = (head > SSM_LOG_RING) ? head - SSM_LOG_RING : 0;
+	ESP_LOGI(TAG, "dump %lu of %lu records", (unsigned long) (head - n), (unsigned long) head);
+	for (; n != head; n++) {
+		const ssm_log_rec_t * slot = &ssm_log_ring[n & (SSM_LOG_RING - 1)];
+		ssm_log_rec_t r;
+		if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != n + 1) {
+			continue; // being written, or already overwritten by a newer record
+		}
+		memcpy(&r, slot, sizeof(r));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != n + 1) {
+			continue;
+		}
+		ssm_log_print(&r);
+	}
+}
@@ -0,0 +1,490 @@
+/*
+ * NVS persistence of registered devices. Each device has its own namespace named after its topic, which holds two
+ * versioned and CRC protected blobs:
+ *   "key"   - identity and key material, written once at registration
+ *   "state" - cipher, mech status and connection state, which change while the device is in use
+ * The last committed blobs are shadowed in RAM. A save only writes the blobs which differ from the shadow, and state
+ * changes are staged and committed together after CONFIG_SSM_NVS_COMMIT_DELAY_S to spare the flash.
+ * All namespaces are enumerated once at boot into a RAM registry, so a device found by the BLE scan is restored
+ * without touching NVS.
+ */
+
+#include "ssm_nvs.h"
+#include "aes-cbc-cmac.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "nvs_flash.h"
+#include "ssm_timer.h"
+#include <stddef.h>
+#include <string.h>
+
+static const char * TAG = "ssm_nvs.c";
+
+#define SSM_NVS_KEY_KEY "key"
+#define SSM_NVS_STATE_KEY "state"
+#define SSM_NVS_VERSION 1
+
+#pragma pack(1)
+
+typedef struct {
+	uint8_t version;
+	uint8_t product_type;
+	uint8_t device_uuid[16];
+	uint8_t public_key[64];
+	uint8_t device_secret[16];
+	uint8_t addr[6];
+	uint32_t crc; // CRC32 of all the fields above
+} ssm_nvs_key_t;
+
+typedef struct {
+	uint8_t version;
+	SesameBleCipher cipher;
+	mech_status_t mech_status;
+	uint16_t c_offset;
+	uint8_t conn_id;
+	uint32_t crc; // CRC32 of all the fields above
+} ssm_nvs_state_t;
+
+#pragma pack()
+
+#define SSM_NVS_DIRTY_KEY (1u << 0)
+#define SSM_NVS_DIRTY_STATE (1u << 1)
+
+typedef struct {
+	sesame * ssm;
+	uint8_t dirty;
+	ssm_nvs_key_t key;	   // staged if dirty, else last committed
+	ssm_nvs_state_t state; // staged if dirty, else last committed
+	uint8_t key_valid;	   // key is in NVS
+	uint8_t state_valid;   // state is in NVS
+} ssm_nvs_shadow_t;
+
+typedef struct {
+	ssm_nvs_key_t key;
+	ssm_nvs_state_t state;
+	uint8_t state_valid;
+	uint8_t cmac_subkey[2][16]; // derived from key.device_secret, so a login costs one AES block
+} ssm_nvs_entry_t;
+
+static ssm_nvs_shadow_t shadow[SSM_MAX_NUM];
+static ssm_nvs_entry_t registry[SSM_MAX_NUM]; // registered devices, mirrors NVS after ssm_nvs_load_registry()
+static uint8_t cnt_registry = 0;
+static uint8_t registry_loaded = 0;
+static SemaphoreHandle_t shadow_lock = NULL; // guards shadow and registry, created by ssm_nvs_init()
+
+static const char * ssm_nvs_legacy_keys[] = { "device_uuid", "public_key", "device_secret", "addr", "cipher", "mech_status", "c_offset", "conn_id" }; // one key per field, before the versioned blobs
+
+#define BLOB_CRC(blob) esp_rom_crc32_le(0, (const uint8_t *) (blob), offsetof(typeof(*(blob)), crc))
+
+static void ssm_gen_topic(sesame * ssm) {
+	// generate topic from MAC address as NVS name. The format is s2mooxxooxxooxx
+	memset(ssm->topic, 0, sizeof(ssm->topic));
+	int cnt = 0;
+	cnt += sprintf(ssm->topic + cnt, "s2m");
+	for (int n = 0; n < 6; n++) {
+		cnt += sprintf(ssm->topic + cnt, "%02x", ssm->addr[n]);
+	}
+}
+
+static ssm_nvs_shadow_t * ssm_nvs_shadow(sesame * ssm) {
+	int idx = (struct ssm_env_tag *) ssm - p_ssms_env; // sesame is the first member of ssm_env_tag
+	if (idx < 0 || idx >= SSM_MAX_NUM) {
+		return NULL;
+	}
+	shadow[idx].ssm = ssm;
+	return &shadow[idx];
+}
+
+void ssm_nvs_init(void) {
+	if (shadow_lock == NULL) {
+		shadow_lock = xSemaphoreCreateMutex();
+	}
+}
+
+static void ssm_nvs_lock(void) {
+	xSemaphoreTake(shadow_lock, portMAX_DELAY);
+}
+
+static void ssm_nvs_unlock(void) {
+	xSemaphoreGive(shadow_lock);
+}
+
+static void ssm_nvs_fill_key(const sesame * ssm, ssm_nvs_key_t * key) {
+	memset(key, 0, sizeof(ssm_nvs_key_t));
+	key->version = SSM_NVS_VERSION;
+	key->product_type = ssm->product_type;
+	memcpy(key->device_uuid, ssm->device_uuid, sizeof(key->device_uuid));
+	memcpy(key->public_key, ssm->public_key, sizeof(key->public_key));
+	memcpy(key->device_secret, ssm->device_secret, sizeof(key->device_secret));
+	memcpy(key->addr, ssm->addr, sizeof(key->addr));
+	key->crc = BLOB_CRC(key);
+}
+
+static void ssm_nvs_fill_state(const sesame * ssm, ssm_nvs_state_t * state) {
+	memset(state, 0, sizeof(ssm_nvs_state_t));
+	state->version = SSM_NVS_VERSION;
+	state->cipher = ssm->cipher;
+	state->mech_status = ssm->mech_status;
+	state->c_offset = ssm->c_offset;
+	state->conn_id = ssm->conn_id;
+	state->crc = BLOB_CRC(state);
+}
+
+// compare with the shadow and mark the blobs which differ, return the dirty flags. Must hold shadow_lock
+static uint8_t ssm_nvs_diff(ssm_nvs_shadow_t * sh, const sesame * ssm) {
+	ssm_nvs_key_t key;
+	ssm_nvs_state_t state;
+	ssm_nvs_fill_key(ssm, &key);
+	ssm_nvs_fill_state(ssm, &state);
+	if (!sh->key_valid || (sh->dirty & SSM_NVS_DIRTY_KEY) || memcmp(&key, &sh->key, sizeof(key)) != 0) {
+		sh->key = key;
+		sh->dirty |= SSM_NVS_DIRTY_KEY;
+	}
+	if (!sh->state_valid || (sh->dirty & SSM_NVS_DIRTY_STATE) || memcmp(&state, &sh->state, sizeof(state)) != 0) {
+		sh->state = state;
+		sh->dirty |= SSM_NVS_DIRTY_STATE;
+	}
+	return sh->dirty;
+}
+
+static ssm_nvs_entry_t * ssm_nvs_registry_find(const uint8_t * addr) {
+	for (int n = 0; n < cnt_registry; n++) {
+		if (memcmp(registry[n].key.addr, addr, 6) == 0) {
+			return &registry[n];
+		}
+	}
+	return NULL;
+}
+
+// add or update a device in the registry. Must hold shadow_lock
+static void ssm_nvs_registry_put(const ssm_nvs_key_t * key, const ssm_nvs_state_t * state) {
+	ssm_nvs_entry_t * e = ssm_nvs_registry_find(key->addr);
+	uint8_t new_secret = (e == NULL || memcmp(e->key.device_secret, key->device_secret, sizeof(key->device_secret)) != 0);
+	if (e == NULL) {
+		if (cnt_registry >= SSM_MAX_NUM) {
+			ESP_LOGW(TAG, "registry is full");
+			return;
+		}
+		e = &registry[cnt_registry++];
+	}
+	e->key = *key;
+	if (new_secret) {
+		AES_CMAC_SUBKEY(key->device_secret, e->cmac_subkey[0], e->cmac_subkey[1]);
+	}
+	if (state != NULL) {
+		e->state = *state;
+		e->state_valid = 1;
+	}
+}
+
+// write the dirty blobs of one device in one commit. Must hold shadow_lock
+static int ssm_nvs_commit(ssm_nvs_shadow_t * sh) {
+	nvs_handle_t my_handle;
+	esp_err_t err;
+
+	if (sh->dirty == 0) {
+		return 1;
+	}
+	err = nvs_open(sh->ssm->topic, NVS_READWRITE, &my_handle);
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "NVS OPEN error");
+		return 0;
+	}
+	if (sh->dirty & SSM_NVS_DIRTY_KEY) {
+		err = nvs_set_blob(my_handle, SSM_NVS_KEY_KEY, &sh->key, sizeof(sh->key));
+	}
+	if (err == ESP_OK && (sh->dirty & SSM_NVS_DIRTY_STATE)) {
+		err = nvs_set_blob(my_handle, SSM_NVS_STATE_KEY, &sh->state, sizeof(sh->state));
+	}
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "NVS write error");
+	} else {
+		err = nvs_commit(my_handle);
+		if (err != ESP_OK) {
+			ESP_LOGE(TAG, "NVS commit error");
+		}
+	}
+	nvs_close(my_handle);
+	if (err != ESP_OK) {
+		return 0; // stay dirty, retried with the next commit
+	}
+	ESP_LOGI(TAG, "NVS of %s committed,%s%s", sh->ssm->topic, (sh->dirty & SSM_NVS_DIRTY_KEY) ? " key" : "", (sh->dirty & SSM_NVS_DIRTY_STATE) ? " state" : "");
+	sh->key_valid |= !!(sh->dirty & SSM_NVS_DIRTY_KEY);
+	sh->state_valid |= !!(sh->dirty & SSM_NVS_DIRTY_STATE);
+	sh->dirty = 0;
+	if (sh->key_valid) {
+		ssm_nvs_registry_put(&sh->key, sh->state_valid ? &sh->state : NULL);
+	}
+	return 1;
+}
+
+static void ssm_nvs_commit_timer_cb(void * arg) { // runs in the timer service task, a flash write would stall the esp_timer task NimBLE relies on
+	ssm_nvs_flush();
+}
+
+static void ssm_nvs_schedule_commit(void) {
+	if (!ssm_timer_pending(ssm_nvs_commit_timer_cb, NULL)) { // changes staged in the meantime go with the same commit
+		ssm_timer_start(ssm_nvs_commit_timer_cb, NULL, CONFIG_SSM_NVS_COMMIT_DELAY_S * 1000, 0);
+	}
+}
+
+static int ssm_read_nvs_blobs(nvs_handle_t my_handle, const char * name, ssm_nvs_entry_t * e) {
+	size_t len = sizeof(e->key);
+	esp_err_t err = nvs_get_blob(my_handle, SSM_NVS_KEY_KEY, &e->key, &len);
+	if (err != ESP_OK) {
+		return 0;
+	}
+	if (len != sizeof(e->key) || e->key.version != SSM_NVS_VERSION || e->key.crc != BLOB_CRC(&e->key)) {
+		ESP_LOGE(TAG, "NVS key of %s is corrupted", name);
+		return 0;
+	}
+
+	len = sizeof(e->state);
+	err = nvs_get_blob(my_handle, SSM_NVS_STATE_KEY, &e->state, &len);
+	e->state_valid = (err == ESP_OK && len == sizeof(e->state) && e->state.version == SSM_NVS_VERSION && e->state.crc == BLOB_CRC(&e->state));
+	if (!e->state_valid) { // the key is enough to login again
+		ESP_LOGW(TAG, "NVS state of %s is not available", name);
+	}
+	return 1;
+}
+
+static int ssm_read_nvs_legacy(nvs_handle_t my_handle, sesame * ssm) { // key layout before the versioned blobs, product type was not saved
+	esp_err_t err;
+	size_t len = 0;
+
+	len = sizeof(ssm->addr);
+	err = nvs_get_blob(my_handle, "addr", ssm->addr, &len);
+	if (err != ESP_OK) {
+		return 0;
+	}
+	len = sizeof(ssm->device_uuid);
+	err = nvs_get_blob(my_handle, "device_uuid", ssm->device_uuid, &len);
+	len = sizeof(ssm->public_key);
+	err = nvs_get_blob(my_handle, "public_key", ssm->public_key, &len);
+	len = sizeof(ssm->device_secret);
+	err = nvs_get_blob(my_handle, "device_secret", ssm->device_secret, &len);
+	len = sizeof(ssm->cipher);
+	err = nvs_get_blob(my_handle, "cipher", (void *) (&ssm->cipher), &len);
+	len = sizeof(ssm->mech_status);
+	err = nvs_get_blob(my_handle, "mech_status", (void *) (&ssm->mech_status), &len);
+	err = nvs_get_u16(my_handle, "c_offset", &ssm->c_offset);
+	err = nvs_get_u8(my_handle, "conn_id", &ssm->conn_id);
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "NVS read error");
+	}
+	return 1;
+}
+
+static void ssm_migrate_nvs(const char * name, const ssm_nvs_entry_t * e) { // replace the legacy keys by the key and state blobs
+	nvs_handle_t my_handle;
+	esp_err_t err = nvs_open(name, NVS_READWRITE, &my_handle);
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "NVS OPEN error");
+		return;
+	}
+	err = nvs_set_blob(my_handle, SSM_NVS_KEY_KEY, &e->key, sizeof(e->key));
+	if (err == ESP_OK) {
+		err = nvs_set_blob(my_handle, SSM_NVS_STATE_KEY, &e->state, sizeof(e->state));
+	}
+	if (err == ESP_OK) {
+		for (int n = 0; n < sizeof(ssm_nvs_legacy_keys) / sizeof(ssm_nvs_legacy_keys[0]); n++) {
+			nvs_erase_key(my_handle, ssm_nvs_legacy_keys[n]);
+		}
+		err = nvs_commit(my_handle);
+	}
+	nvs_close(my_handle);
+	if (err == ESP_OK) {
+		ESP_LOGI(TAG, "NVS of %s migrated to version %d", name, SSM_NVS_VERSION);
+	} else {
+		ESP_LOGW(TAG, "NVS migration of %s failed", name);
+	}
+}
+
+// read one namespace into e, migrating older layouts on the way
+static int ssm_read_nvs_entry(const char * name, ssm_nvs_entry_t * e) {
+	nvs_handle_t my_handle;
+	uint8_t found = 0, migrate = 0;
+	esp_err_t err = nvs_open(name, NVS_READONLY, &my_handle);
+	if (err != ESP_OK) {
+		return 0;
+	}
+	found = ssm_read_nvs_blobs(my_handle, name, e);
+	if (!found) {
+		static sesame ssm; // only used while loading, keep it off the stack
+		memset(&ssm, 0, sizeof(ssm));
+		found = migrate = ssm_read_nvs_legacy(my_handle, &ssm);
+		if (found) {
+			ssm_nvs_fill_key(&ssm, &e->key);
+			ssm_nvs_fill_state(&ssm, &e->state);
+			e->state_valid = 1;
+		}
+	}
+	nvs_close(my_handle);
+	if (migrate) {
+		ssm_migrate_nvs(name, e);
+	}
+	return found;
+}
+
+int ssm_nvs_load_registry(void) {
+	char names[SSM_MAX_NUM][16];
+	int cnt_names = 0;
+	nvs_iterator_t it = NULL;
+
+	// collect the namespaces first, a migration must not write NVS while iterating it
+	esp_err_t err = nvs_entry_find(NVS_DEFAULT_PART_NAME, NULL, NVS_TYPE_ANY, &it);
+	while (err == ESP_OK) {
+		nvs_entry_info_t info;
+		nvs_entry_info(it, &info);
+		if (strncmp(info.namespace_name, "s2m", 3) == 0 && strlen(info.namespace_name) == 15) {
+			int n;
+			for (n = 0; n < cnt_names && strcmp(names[n], info.namespace_name) != 0; n++) {
+			}
+			if (n == cnt_names) {
+				if (cnt_names < SSM_MAX_NUM) {
+					strcpy(names[cnt_names++], info.namespace_name);
+				} else {
+					ESP_LOGW(TAG, "more than %d devices in NVS, %s is ignored", SSM_MAX_NUM, info.namespace_name);
+				}
+			}
+		}
+		err = nvs_entry_next(&it);
+	}
+	nvs_release_iterator(it);
+
+	ssm_nvs_lock();
+	cnt_registry = 0;
+	ssm_nvs_unlock();
+	for (int n = 0; n < cnt_names; n++) {
+		ssm_nvs_entry_t e;
+		memset(&e, 0, sizeof(e));
+		if (ssm_read_nvs_entry(names[n], &e)) {
+			ssm_nvs_lock();
+			ssm_nvs_registry_put(&e.key, e.state_valid ? &e.state : NULL);
+			ssm_nvs_unlock();
+		}
+	}
+	registry_loaded = 1;
+	ESP_LOGI(TAG, "%d registered devices in NVS", cnt_registry);
+	return cnt_registry;
+}
+
+int ssm_nvs_registry_addrs(uint8_t (*addrs)[6], int max) {
+	int cnt = 0;
+	ssm_nvs_lock();
+	for (; cnt < cnt_registry && cnt < max; cnt++) {
+		memcpy(addrs[cnt], registry[cnt].key.addr, 6);
+	}
+	ssm_nvs_unlock();
+	return cnt;
+}
+
+uint8_t ssm_nvs_registry_product(const uint8_t * addr) {
+	uint8_t product_type = 0;
+	ssm_nvs_lock();
+	ssm_nvs_entry_t * r = ssm_nvs_registry_find(addr);
+	if (r != NULL) {
+		product_type = r->key.product_type;
+	}
+	ssm_nvs_unlock();
+	return product_type;
+}
+
+int ssm_read_nvs(sesame * ssm) {
+	ssm_nvs_entry_t e;
+	uint8_t found = 0;
+	ssm_nvs_shadow_t * sh = ssm_nvs_shadow(ssm);
+
+	ssm_gen_topic(ssm);
+	if (registry_loaded) { // memory only, the registry mirrors NVS
+		ssm_nvs_lock();
+		ssm_nvs_entry_t * r = ssm_nvs_registry_find(ssm->addr);
+		if (r != NULL) {
+			e = *r;
+			found = 1;
+		}
+		ssm_nvs_unlock();
+	} else {
+		found = ssm_read_nvs_entry(ssm->topic, &e) && memcmp(e.key.addr, ssm->addr, 6) == 0; // double check if the address is the same
+		if (found) {
+			AES_CMAC_SUBKEY(e.key.device_secret, e.cmac_subkey[0], e.cmac_subkey[1]);
+		}
+	}
+
+	if (found) {
+		memcpy(ssm->device_uuid, e.key.device_uuid, sizeof(ssm->device_uuid));
+		memcpy(ssm->public_key, e.key.public_key, sizeof(ssm->public_key));
+		memcpy(ssm->device_secret, e.key.device_secret, sizeof(ssm->device_secret));
+		memcpy(ssm->cmac_subkey, e.cmac_subkey, sizeof(ssm->cmac_subkey));
+		ssm->cmac_subkey_valid = 1;
+		if (e.state_valid) {
+			ssm->cipher = e.state.cipher;
+			ssm->mech_status = e.state.mech_status;
+			ssm->c_offset = e.state.c_offset;
+			ssm->conn_id = e.state.conn_id;
+		}
+		if (sh != NULL) {
+			ssm_nvs_lock();
+			sh->key = e.key;
+			sh->key_valid = 1;
+			sh->state = e.state;
+			sh->state_valid = e.state_valid;
+			sh->dirty = 0;
+			ssm_nvs_unlock();
+		}
+		ESP_LOGI(TAG, "NVS read done");
+	} else {
+		ESP_LOGW(TAG, "NVS read failed");
+	}
+	return found;
+}
+
+int ssm_save_nvs(sesame * ssm) {
+	int save_done = 0;
+	ssm_nvs_shadow_t * sh = ssm_nvs_shadow(ssm);
+
+	ssm_gen_topic(ssm);
+	if (sh == NULL) {
+		ESP_LOGE(TAG, "%s is not in ssm env", ssm->topic);
+	} else {
+		ssm_nvs_lock();
+		ssm_nvs_diff(sh, ssm);
+		save_done = ssm_nvs_commit(sh);
+		ssm_nvs_unlock();
+	}
+
+	if (save_done) {
+		ESP_LOGI(TAG, "NVS save done");
+	} else {
+		ESP_LOGW(TAG, "NVS save failed");
+	}
+	return save_done;
+}
+
+void ssm_nvs_stage(sesame * ssm) {
+	ssm_nvs_shadow_t * sh = ssm_nvs_shadow(ssm);
+	if (sh == NULL || ssm->topic[0] == 0) { // not registered
+		return;
+	}
+	ssm_nvs_lock();
+	uint8_t dirty = ssm_nvs_diff(sh, ssm);
+	ssm_nvs_unlock();
+	if (dirty) {
+		ssm_nvs_schedule_commit();
+	}
+}
+
+void ssm_nvs_flush(void) {
+	ssm_timer_stop(ssm_nvs_commit_timer_cb, NULL);
+	ssm_nvs_lock();
+	for (int n = 0; n < SSM_MAX_NUM; n++) {
+		if (shadow[n].dirty && !ssm_nvs_commit(&shadow[n])) {
+			ssm_nvs_unlock();
+			ssm_nvs_schedule_commit(); // retry later
+			return;
+		}
+	}
+	ssm_nvs_unlock();
+}
@@ -0,0 +1,111 @@
+/*
+ * RSSI statistics. Every advertisement seen while scanning adds a sample to a small ring per device and to an EWMA in
+ * Q4 fixed point. The RSSI sweep takes the EWMA, min/max and the 10th and 90th percentile of the interval, which say
+ * much more about the placement of the bridge than the last sample.
+ */
+
+#include "ssm_rssi.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <string.h>
+
+#define SSM_RSSI_RING 64 // samples kept for the percentiles, the newest ones of the interval
+#define SSM_RSSI_EWMA_SHIFT 3 // alpha = 1/8, about the last 8 advertisements
+_Static_assert((SSM_RSSI_RING & (SSM_RSSI_RING - 1)) == 0, "SSM_RSSI_RING must be a power of 2");
+
+typedef struct {
+	int8_t ring[SSM_RSSI_RING];
+	uint8_t head;	 // next slot to write
+	uint16_t n;		 // samples in the interval, may exceed SSM_RSSI_RING
+	int16_t ewma_q4; // EWMA * 16
+	uint8_t ewma_valid;
+	int8_t min;
+	int8_t max;
+} ssm_rssi_ring_t;
+
+static ssm_rssi_ring_t rings[SSM_MAX_NUM];
+static SemaphoreHandle_t rssi_lock = NULL; // the scan adds in the BLE host task, the sweep takes in the timer task
+
+static ssm_rssi_ring_t * ssm_rssi_ring(sesame * ssm) {
+	int idx = (struct ssm_env_tag *) ssm - p_ssms_env; // sesame is the first member of ssm_env_tag
+	if (idx < 0 || idx >= SSM_MAX_NUM || rssi_lock == NULL) {
+		return NULL;
+	}
+	return &rings[idx];
+}
+
+void ssm_rssi_init(void) {
+	if (rssi_lock == NULL) {
+		rssi_lock = xSemaphoreCreateMutex();
+	}
+}
+
+void ssm_rssi_add(sesame * ssm, int8_t rssi) {
+	ssm_rssi_ring_t * r = ssm_rssi_ring(ssm);
+	if (r == NULL) {
+		return;
+	}
+	xSemaphoreTake(rssi_lock, portMAX_DELAY);
+	r->ring[r->head] = rssi;
+	r->head = (r->head + 1) & (SSM_RSSI_RING - 1);
+	if (r->n == 0 || rssi < r->min) {
+		r->min = rssi;
+	}
+	if (r->n == 0 || rssi > r->max) {
+		r->max = rssi;
+	}
+	if (r->n < UINT16_MAX) {
+		r->n++;
+	}
+	if (r->ewma_valid) {
+		r->ewma_q4 += ((rssi * 16) - r->ewma_q4) >> SSM_RSSI_EWMA_SHIFT;
+	} else {
+		r->ewma_q4 = rssi * 16;
+		r->ewma_valid = 1;
+	}
+	xSemaphoreGive(rssi_lock);
+}
+
+int ssm_rssi_take(sesame * ssm, ssm_rssi_stats_t * stats) {
+	ssm_rssi_ring_t * r = ssm_rssi_ring(ssm);
+	int8_t sorted[SSM_RSSI_RING];
+	uint16_t cnt;
+	if (r == NULL) {
+		return 0;
+	}
+	xSemaphoreTake(rssi_lock, portMAX_DELAY);
+	stats->n = r->n;
+	cnt = (r->n < SSM_RSSI_RING) ? r->n : SSM_RSSI_RING;
+	for (uint16_t k = 0; k < cnt; k++) { // the newest cnt samples end at head
+		sorted[k] = r->ring[(r->head - 1 - k) & (SSM_RSSI_RING - 1)];
+	}
+	stats->ewma = (int8_t) ((r->ewma_q4 + (r->ewma_q4 < 0 ? -8 : 8)) / 16); // rounded
+	stats->min = r->min;
+	stats->max = r->max;
+	r->n = 0;
+	xSemaphoreGive(rssi_lock);
+	if (cnt == 0) {
+		return 0;
+	}
+	for (uint16_t k = 1; k < cnt; k++) { // insertion sort, at most 64 samples once a minute
+		int8_t v = sorted[k];
+		int j = k;
+		for (; j > 0 && sorted[j - 1] > v; j--) {
+			sorted[j] = sorted[j - 1];
+		}
+		sorted[j] = v;
+	}
+	stats->p10 = sorted[(cnt - 1) * 10 / 100]; // nearest rank below
+	stats->p90 = sorted[(cnt - 1) * 90 / 100];
+	return 1;
+}
+
+void ssm_rssi_reset(sesame * ssm) {
+	ssm_rssi_ring_t * r = ssm_rssi_ring(ssm);
+	if (r == NULL) {
+		return;
+	}
+	xSemaphoreTake(rssi_lock, portMAX_DELAY);
+	memset(r, 0, sizeof(*r));
+	xSemaphoreGive(rssi_lock);
+}
@@ -0,0 +1,88 @@
+/*
+ * Link supervisor. A failing BLE device, Wi-Fi or MQTT link is retried with exponential backoff instead of restarting
+ * the ESP, so one flaky lock doesn't drop the sessions of the other devices, the MQTT connection and the discovery
+ * state. A controller error resets the NimBLE stack only, and the ESP is restarted when a stack reset doesn't help.
+ */
+
+#include "ssm_sup.h"
+#include "blecent.h"
+#include "esp_log.h"
+#include "esp_random.h"
+#include "esp_system.h"
+#include "host/ble_hs.h"
+#include "ssm_conn.h"
+#include "ssm_nvs.h"
+#include "ssm_timer.h"
+
+static const char * TAG = "ssm_sup.c";
+
+#define SSM_SUP_BLE_RETRY_MS 600 // the first reconnect, the device needs a moment after a disconnect
+#define SSM_SUP_BLE_RESET_WINDOW_US (5 * 1000000LL) // errors within this window are one reset
+
+static uint8_t ble_resets = 0; // stack resets since the last login
+static int64_t t_last_reset_us = 0;
+
+uint32_t ssm_backoff_next(ssm_backoff_t * b, uint32_t base_ms) {
+	uint32_t max_ms = CONFIG_SSM_BACKOFF_MAX_S * 1000;
+	uint32_t delay_ms = base_ms;
+	for (uint16_t n = 0; n < b->failures && delay_ms < max_ms; n++) {
+		delay_ms *= 2;
+	}
+	if (delay_ms > max_ms) {
+		delay_ms = max_ms;
+	}
+	if (b->failures < UINT16_MAX) {
+		b->failures++;
+	}
+	return delay_ms - delay_ms / 4 + esp_random() % (delay_ms / 2 + 1); // +-25 %, links failing together don't retry together
+}
+
+void ssm_backoff_reset(ssm_backoff_t * b) {
+	b->failures = 0;
+}
+
+static void ssm_sup_ble_retry(void * arg) {
+	sesame * ssm = (sesame *) arg;
+	ssm_conn_t * c = ssm_conn_get(ssm);
+	if (ssm->device_status <= SSM_DISCONNECTED && (c == NULL || c->phase == SSM_CONN_IDLE)) { // not reconnected by a user command meanwhile
+		reconnect(ssm);
+	}
+}
+
+void ssm_sup_ble_link_up(sesame * ssm) {
+	ssm_conn_t * c = ssm_conn_get(ssm);
+	if (c != NULL) {
+		ssm_backoff_reset(&c->backoff);
+	}
+	ble_resets = 0;
+}
+
+void ssm_sup_ble_link_down(sesame * ssm, const char * why) {
+	ssm_conn_t * c = ssm_conn_get(ssm);
+	if (c == NULL || ssm_timer_pending(ssm_sup_ble_retry, ssm)) { // one retry at a time
+		return;
+	}
+	uint32_t delay_ms = ssm_backoff_next(&c->backoff, SSM_SUP_BLE_RETRY_MS);
+	ESP_LOGW(TAG, "%s %s, retry %u in %lu ms", SSM_PRODUCT_TYPE_STR(ssm->product_type), why, c->backoff.failures, (unsigned long) delay_ms);
+	ssm_timer_start(ssm_sup_ble_retry, ssm, delay_ms, 0);
+}
+
+void ssm_sup_ble_stack_error(int reason, uint8_t reset) {
+	int64_t now_us = ssm_timer_now_us();
+	if (ble_resets == 0 || now_us - t_last_reset_us > SSM_SUP_BLE_RESET_WINDOW_US) { // every link reports the same reset
+		t_last_reset_us = now_us;
+		if (CONFIG_SSM_BLE_RESET_LIMIT > 0 && ++ble_resets > CONFIG_SSM_BLE_RESET_LIMIT) {
+			ssm_sup_restart("BLE stack doesn't recover");
+		}
+		ESP_LOGE(TAG, "BLE stack error %d, reset %u of %d", reason, ble_resets, CONFIG_SSM_BLE_RESET_LIMIT);
+	}
+	if (reset) {
+		ble_hs_sched_reset(reason); // every link gets a disconnect event and is retried, scan resumes in sync_cb
+	}
+}
+
+void ssm_sup_restart(const char * why) {
+	ESP_LOGE(TAG, "restart ESP: %s", why);
+	ssm_nvs_flush();
+	esp_restart();
+}
@@ -0,0 +1,109 @@
+/*
+ * Telemetry filter. A metric is published when it moved at least its deadband away from the value published last,
+ * so a value wobbling around one threshold doesn't toggle, and not more often than the minimum interval. A change
+ * held back by the interval is published when the interval ends, so the last value always reaches the broker.
+ * Lock state changes bypass the filter.
+ */
+
+#include "ssm_telemetry.h"
+#include "esp_log.h"
+#include "mqtt_section.h"
+#include "ssm_timer.h"
+#include <stdlib.h>
+
+static const char * TAG = "ssm_telemetry.c";
+
+static const int32_t ssm_metric_deadband[SSM_METRIC_NUM] = {
+	[SSM_METRIC_RSSI] = CONFIG_SSM_TELEMETRY_RSSI_DEADBAND,
+	[SSM_METRIC_BATTERY] = CONFIG_SSM_TELEMETRY_BATTERY_STEP,
+	[SSM_METRIC_POSITION] = CONFIG_SSM_TELEMETRY_POSITION_TOLERANCE,
+};
+
+typedef struct {
+	int32_t value; // published last
+	int64_t t_us;  // when value was published
+	uint8_t valid; // 0: nothing published yet
+} ssm_metric_state_t;
+
+static ssm_metric_state_t metrics[SSM_MAX_NUM][SSM_METRIC_NUM];
+
+static ssm_metric_state_t * ssm_metric_state(sesame * ssm, ssm_metric_t metric) {
+	int idx = (struct ssm_env_tag *) ssm - p_ssms_env; // sesame is the first member of ssm_env_tag
+	if (idx < 0 || idx >= SSM_MAX_NUM || metric >= SSM_METRIC_NUM) {
+		return NULL;
+	}
+	return &metrics[idx][metric];
+}
+
+static void ssm_metric_commit(ssm_metric_state_t * m, int32_t value, int64_t now_us) {
+	m->value = value;
+	m->t_us = now_us;
+	m->valid = 1;
+}
+
+int ssm_telemetry_filter(sesame * ssm, ssm_metric_t metric, int32_t value, uint32_t * wait_ms) {
+	ssm_metric_state_t * m = ssm_metric_state(ssm, metric);
+	int64_t now_us = ssm_timer_now_us();
+	if (wait_ms != NULL) {
+		*wait_ms = 0;
+	}
+	if (m == NULL) {
+		return 1;
+	}
+	if (m->valid && (value == m->value || abs(value - m->value) < ssm_metric_deadband[metric])) {
+		return 0; // noise
+	}
+	int64_t left_us = m->valid ? m->t_us + CONFIG_SSM_TELEMETRY_MIN_INTERVAL_S * 1000000LL - now_us : 0;
+	if (left_us > 0) {
+		if (wait_ms != NULL) {
+			*wait_ms = (uint32_t) (left_us / 1000) + 1;
+		}
+		return 0;
+	}
+	ssm_metric_commit(m, value, now_us);
+	return 1;
+}
+
+void ssm_telemetry_reset(sesame * ssm, ssm_metric_t metric) {
+	ssm_metric_state_t * m = ssm_metric_state(ssm, metric);
+	if (m != NULL) {
+		m->valid = 0;
+	}
+}
+
+static void ssm_telemetry_commit_status(sesame * ssm) {
+	int64_t now_us = ssm_timer_now_us();
+	ssm_metric_state_t * m = ssm_metric_state(ssm, SSM_METRIC_BATTERY);
+	if (m != NULL) {
+		ssm_metric_commit(m, (int32_t) ssm->battery_percentage, now_us);
+		ssm_metric_commit(ssm_metric_state(ssm, SSM_METRIC_POSITION), ssm->mech_status.position, now_us);
+	}
+}
+
+static void ssm_telemetry_trailing(void * arg) { // the minimum interval of a held change ended
+	sesame * ssm = (sesame *) arg;
+	if (mqtt_starting()) { // published with the status by mqtt_sync_devices()
+		return;
+	}
+	ssm_telemetry_commit_status(ssm);
+	ESP_LOGI(TAG, "%s publish held battery or position", SSM_PRODUCT_TYPE_STR(ssm->product_type));
+	mqtt_publish_status(ssm); // not the status callback, it may talk to the device and this is not the NimBLE host task
+}
+
+int ssm_telemetry_status(sesame * ssm, uint8_t state_changed) {
+	uint32_t wait_battery_ms = 0, wait_position_ms = 0;
+	if (!state_changed) {
+		state_changed = ssm_telemetry_filter(ssm, SSM_METRIC_BATTERY, (int32_t) ssm->battery_percentage, &wait_battery_ms);
+		state_changed |= ssm_telemetry_filter(ssm, SSM_METRIC_POSITION, ssm->mech_status.position, &wait_position_ms);
+	}
+	if (state_changed) { // the callback publishes battery and position too
+		ssm_timer_stop(ssm_telemetry_trailing, ssm);
+		ssm_telemetry_commit_status(ssm);
+		return 1;
+	}
+	uint32_t wait_ms = (wait_battery_ms && (!wait_position_ms || wait_battery_ms < wait_position_ms)) ? wait_battery_ms : wait_position_ms;
+	if (wait_ms && !ssm_timer_pending(ssm_telemetry_trailing, ssm)) {
+		ssm_timer_start(ssm_telemetry_trailing, ssm, wait_ms, 0);
+	}
+	return 0;
+}
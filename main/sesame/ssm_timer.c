@@ -0,0 +1,198 @@
+/*
+ * Timer service. All periodic work and timeouts are kept in one small table with their due time on the monotonic
+ * clock, and a single one-shot esp_timer is armed for the earliest one. When it fires, the service task runs the due
+ * callbacks, so a callback may publish MQTT or start a BLE connection, which is not allowed in the esp_timer task.
+ * Nothing wakes up between deadlines, and wall-clock jumps after SNTP sync don't move them.
+ */
+
+#include "ssm_timer.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+#include "ssm.h"
+
+static const char * TAG = "ssm_timer.c";
+
+#define SSM_TIMER_MAX 24 // a BLE retry and a held telemetry change per device, and the periodic work
+#define SSM_TIMER_STACK_SIZE 4096
+#define SSM_TIMER_PRIORITY (tskIDLE_PRIORITY + 3)
+
+typedef struct {
+	ssm_timer_cb cb; // NULL if the slot is free
+	void * arg;
+	int64_t due_us;
+	int64_t period_us; // 0 for one shot
+} ssm_timer_t;
+
+static ssm_timer_t timers[SSM_TIMER_MAX];
+static SemaphoreHandle_t timer_lock = NULL;
+static TaskHandle_t timer_task = NULL;
+static esp_timer_handle_t timer_alarm = NULL;
+
+struct timeval tv_start, tv_1min; // monotonic time of start_timer() and of the last timer_1min() period
+
+int64_t ssm_timer_now_us(void) {
+	return esp_timer_get_time();
+}
+
+static void ssm_timer_now_tv(struct timeval * tv) {
+	int64_t now_us = ssm_timer_now_us();
+	tv->tv_sec = now_us / 1000000;
+	tv->tv_usec = now_us % 1000000;
+}
+
+// arm the alarm for the earliest timer, timer_lock is held
+static void ssm_timer_arm(void) {
+	int64_t due_us = INT64_MAX;
+	for (int n = 0; n < SSM_TIMER_MAX; n++) {
+		if (timers[n].cb != NULL && timers[n].due_us < due_us) {
+			due_us = timers[n].due_us;
+		}
+	}
+	if (due_us == INT64_MAX) {
+		return;
+	}
+	int64_t delay_us = due_us - ssm_timer_now_us();
+	esp_timer_stop(timer_alarm); // ESP_ERR_INVALID_STATE if not running
+	if (delay_us > 0 && esp_timer_start_once(timer_alarm, (uint64_t) delay_us) == ESP_OK) {
+		return;
+	}
+	xTaskNotifyGive(timer_task); // due already
+}
+
+static void ssm_timer_alarm_cb(void * arg) {
+	xTaskNotifyGive(timer_task);
+}
+
+static void ssm_timer_task(void * param) {
+	for (;;) {
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+		for (;;) {
+			ssm_timer_cb cb = NULL;
+			void * arg = NULL;
+			int64_t now_us = ssm_timer_now_us();
+			xSemaphoreTake(timer_lock, portMAX_DELAY);
+			for (int n = 0; n < SSM_TIMER_MAX; n++) {
+				ssm_timer_t * t = &timers[n];
+				if (t->cb == NULL || t->due_us > now_us) {
+					continue;
+				}
+				cb = t->cb;
+				arg = t->arg;
+				if (t->period_us) {
+					t->due_us += t->period_us;
+					if (t->due_us <= now_us) { // skip the missed periods instead of running them back to back
+						t->due_us = now_us + t->period_us;
+					}
+				} else {
+					t->cb = NULL;
+				}
+				break;
+			}
+			if (cb == NULL) {
+				ssm_timer_arm();
+			}
+			xSemaphoreGive(timer_lock);
+			if (cb == NULL) {
+				break;
+			}
+			cb(arg);
+		}
+	}
+}
+
+void ssm_timer_init(void) {
+	timer_lock = xSemaphoreCreateMutex();
+	if (timer_lock == NULL || xTaskCreate(ssm_timer_task, "ssm_timer", SSM_TIMER_STACK_SIZE, NULL, SSM_TIMER_PRIORITY, &timer_task) != pdPASS) {
+		ESP_LOGE(TAG, "[ssm_timer_init][FAIL]");
+		return;
+	}
+	const esp_timer_create_args_t args = {
+		.callback = ssm_timer_alarm_cb,
+		.name = "ssm_timer",
+	};
+	if (esp_timer_create(&args, &timer_alarm) != ESP_OK) {
+		ESP_LOGE(TAG, "[ssm_timer_init][esp_timer_create][FAIL]");
+	}
+}
+
+int ssm_timer_start(ssm_timer_cb cb, void * arg, uint32_t delay_ms, uint32_t period_ms) {
+	if (timer_task == NULL) { // ssm_timer_init() not called or failed
+		return 0;
+	}
+	xSemaphoreTake(timer_lock, portMAX_DELAY);
+	ssm_timer_t * t = NULL;
+	for (int n = 0; n < SSM_TIMER_MAX; n++) {
+		if (timers[n].cb == cb && timers[n].arg == arg) { // re-arm
+			t = &timers[n];
+			break;
+		}
+		if (t == NULL && timers[n].cb == NULL) {
+			t = &timers[n];
+		}
+	}
+	if (t != NULL) {
+		t->cb = cb;
+		t->arg = arg;
+		t->due_us = ssm_timer_now_us() + (int64_t) delay_ms * 1000;
+		t->period_us = (int64_t) period_ms * 1000;
+		ssm_timer_arm();
+	}
+	xSemaphoreGive(timer_lock);
+	if (t == NULL) {
+		ESP_LOGE(TAG, "timer table full");
+		return 0;
+	}
+	return 1;
+}
+
+void ssm_timer_stop(ssm_timer_cb cb, void * arg) {
+	if (timer_task == NULL) {
+		return;
+	}
+	xSemaphoreTake(timer_lock, portMAX_DELAY);
+	for (int n = 0; n < SSM_TIMER_MAX; n++) {
+		if (timers[n].cb == cb && timers[n].arg == arg) {
+			timers[n].cb = NULL;
+		}
+	}
+	xSemaphoreGive(timer_lock); // the alarm may still fire once, the task finds nothing due
+}
+
+int ssm_timer_pending(ssm_timer_cb cb, void * arg) {
+	int pending = 0;
+	if (timer_task == NULL) {
+		return 0;
+	}
+	xSemaphoreTake(timer_lock, portMAX_DELAY);
+	for (int n = 0; n < SSM_TIMER_MAX; n++) {
+		if (timers[n].cb == cb && timers[n].arg == arg) {
+			pending = 1;
+		}
+	}
+	xSemaphoreGive(timer_lock);
+	return pending;
+}
+
+int timer_1min(void) {
+	struct timeval tv_now;
+	ssm_timer_now_tv(&tv_now);
+	if (tv_now.tv_sec - tv_1min.tv_sec >= 60) {
+		tv_1min = tv_now; // restart timer
+		return 1;
+	}
+	return 0;
+}
+
+void start_timer(void) {
+	ssm_timer_now_tv(&tv_start); // loop start timer
+}
+
+int loop_timeout(void) {
+	struct timeval tv_now;
+	ssm_timer_now_tv(&tv_now);
+	return tv_now.tv_sec - tv_start.tv_sec > CONFIG_ESP_TASK_WDT_TIMEOUT_S - 3; // timeout 3 secs before the task watchdog
+}
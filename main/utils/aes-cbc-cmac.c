@@ -183,12 +183,22 @@ static void padding(const unsigned char *lastb, unsigned char *pad, int length)
 	}
 }
 
+void AES_CMAC_SUBKEY(const unsigned char *key, unsigned char *K1, unsigned char *K2) {
+	generate_subkey(key, K1, K2);
+}
+
 void AES_CMAC(const unsigned char *key, const unsigned char *input, int length,
 		unsigned char *mac) {
-	unsigned char X[BLOCK_SIZE], Y[BLOCK_SIZE], M_last[BLOCK_SIZE], padded[BLOCK_SIZE];
 	unsigned char K1[BLOCK_SIZE], K2[BLOCK_SIZE];
-	int n, i, flag;
 	generate_subkey(key, K1, K2);
+	AES_CMAC_PRECOMPUTED(key, K1, K2, input, length, mac);
+}
+
+void AES_CMAC_PRECOMPUTED(const unsigned char *key, const unsigned char *K1,
+		const unsigned char *K2, const unsigned char *input, int length,
+		unsigned char *mac) {
+	unsigned char X[BLOCK_SIZE], Y[BLOCK_SIZE], M_last[BLOCK_SIZE], padded[BLOCK_SIZE];
+	int n, i, flag;
 
 	n = (length + LAST_INDEX) / BLOCK_SIZE; /* n is number of rounds */
 
@@ -0,0 +1,259 @@
+/*
+ * Streaming parser for the JSON command payloads sent by Home Assistant, e.g.
+ *   {"action": "lock", "code": "1234"}
+ *   { "action": "set_lock_position", "lock": "160" }
+ *   { "action": "add_sesame", "mac": "aa:bb:cc:dd:ee:ff" }
+ * The payload is tokenized in place, no copy and no allocation is made. Key order and whitespace do not matter,
+ * unknown keys and nested values are skipped. A payload which is not a JSON object is taken as the action itself.
+ * The action is then looked up in MQTT_ACTION_LIST with a perfect hash built at compile time.
+ */
+
+#include "mqtt_cmd.h"
+#include <string.h>
+
+typedef struct {
+	const char * p;
+	const char * end;
+} json_cursor_t;
+
+static int is_ws(char c) {
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static void skip_ws(json_cursor_t * c) {
+	while (c->p < c->end && is_ws(*c->p)) {
+		c->p++;
+	}
+}
+
+static int hex_nibble(char c) {
+	if (c >= '0' && c <= '9') {
+		return c - '0';
+	} else if (c >= 'a' && c <= 'f') {
+		return c - 'a' + 10;
+	} else if (c >= 'A' && c <= 'F') {
+		return c - 'A' + 10;
+	}
+	return -1;
+}
+
+// cursor is on the opening quote. Escape sequences are kept as is, none of the expected values contains one
+static int scan_string(json_cursor_t * c, mqtt_cmd_str_t * str) {
+	const char * start = ++c->p;
+	while (c->p < c->end) {
+		if (*c->p == '\\') {
+			c->p += 2;
+			continue;
+		}
+		if (*c->p == '"') {
+			str->ptr = start;
+			str->len = (uint16_t) (c->p - start);
+			c->p++;
+			return 1;
+		}
+		c->p++;
+	}
+	return 0; // unterminated string
+}
+
+static int scan_value(json_cursor_t * c, mqtt_cmd_str_t * val) {
+	if (c->p >= c->end) {
+		return 0;
+	}
+	if (*c->p == '"') {
+		return scan_string(c, val);
+	}
+	val->ptr = c->p;
+	if (*c->p == '{' || *c->p == '[') { // nested object or array, skip it as a whole
+		int depth = 0;
+		while (c->p < c->end) {
+			if (*c->p == '"') {
+				mqtt_cmd_str_t skipped;
+				if (!scan_string(c, &skipped)) {
+					return 0;
+				}
+				continue;
+			}
+			if (*c->p == '{' || *c->p == '[') {
+				depth++;
+			} else if ((*c->p == '}' || *c->p == ']') && --depth == 0) {
+				c->p++;
+				val->len = (uint16_t) (c->p - val->ptr);
+				return 1;
+			}
+			c->p++;
+		}
+		return 0;
+	}
+	while (c->p < c->end && *c->p != ',' && *c->p != '}' && *c->p != ']' && !is_ws(*c->p)) { // number, true, false or null
+		c->p++;
+	}
+	val->len = (uint16_t) (c->p - val->ptr);
+	return val->len > 0;
+}
+
+// accept "160", "-20", "160.0" and " 160 ". Fraction is truncated like the former (int) atof()
+static int parse_position(const mqtt_cmd_str_t * val, int16_t * position) {
+	const char * p = val->ptr;
+	const char * end = val->ptr + val->len;
+	int negative = 0, digits = 0;
+	int32_t v = 0;
+
+	while (p < end && is_ws(*p)) {
+		p++;
+	}
+	if (p < end && (*p == '-' || *p == '+')) {
+		negative = (*p++ == '-');
+	}
+	for (; p < end && *p >= '0' && *p <= '9'; p++, digits++) {
+		if (v < 100000) { // saturate, clamped below
+			v = v * 10 + (*p - '0');
+		}
+	}
+	if (p < end && *p == '.') {
+		for (p++; p < end && *p >= '0' && *p <= '9'; p++) {
+		}
+	}
+	while (p < end && is_ws(*p)) {
+		p++;
+	}
+	if (digits == 0 || p != end) {
+		return 0;
+	}
+	v = negative ? -v : v;
+	*position = (int16_t) (v > INT16_MAX ? INT16_MAX : (v < INT16_MIN ? INT16_MIN : v));
+	return 1;
+}
+
+static void assign_field(mqtt_cmd_t * cmd, const mqtt_cmd_str_t * key, const mqtt_cmd_str_t * val) {
+	if (mqtt_cmd_str_eq(key, "action")) {
+		cmd->action = *val;
+	} else if (mqtt_cmd_str_eq(key, "code")) {
+		cmd->code = *val;
+	} else if (mqtt_cmd_str_eq(key, "mac") || mqtt_cmd_str_eq(key, "addr")) {
+		cmd->mac = *val;
+	} else if (mqtt_cmd_str_eq(key, "lock") || mqtt_cmd_str_eq(key, "unlock") || mqtt_cmd_str_eq(key, "position")) {
+		cmd->has_position = parse_position(val, &cmd->position);
+	}
+}
+
+int mqtt_cmd_parse(const char * data, int len, mqtt_cmd_t * cmd) {
+	memset(cmd, 0, sizeof(mqtt_cmd_t));
+	if (data == NULL || len <= 0 || len > UINT16_MAX) {
+		return 0;
+	}
+	json_cursor_t c = { data, data + len };
+	skip_ws(&c);
+	if (c.p >= c.end) {
+		return 0;
+	}
+	if (*c.p == '"') { // quoted plain payload
+		return scan_string(&c, &cmd->action) && cmd->action.len > 0;
+	}
+	if (*c.p != '{') { // plain payload, e.g. "lock"
+		const char * end = c.end;
+		while (end > c.p && is_ws(end[-1])) {
+			end--;
+		}
+		cmd->action.ptr = c.p;
+		cmd->action.len = (uint16_t) (end - c.p);
+		return 1;
+	}
+
+	c.p++;
+	for (;;) {
+		mqtt_cmd_str_t key, val;
+		skip_ws(&c);
+		if (c.p >= c.end) {
+			return 0; // unterminated object
+		}
+		if (*c.p == '}') {
+			break;
+		}
+		if (*c.p != '"' || !scan_string(&c, &key)) {
+			return 0;
+		}
+		skip_ws(&c);
+		if (c.p >= c.end || *c.p != ':') {
+			return 0;
+		}
+		c.p++;
+		skip_ws(&c);
+		if (!scan_value(&c, &val)) {
+			return 0;
+		}
+		assign_field(cmd, &key, &val);
+		skip_ws(&c);
+		if (c.p < c.end && *c.p == ',') {
+			c.p++;
+		} else if (c.p < c.end && *c.p == '}') {
+			break;
+		} else {
+			return 0;
+		}
+	}
+	return cmd->action.len > 0;
+}
+
+int mqtt_cmd_str_eq(const mqtt_cmd_str_t * str, const char * literal) {
+	size_t len = strlen(literal);
+	return str->len == len && memcmp(str->ptr, literal, len) == 0;
+}
+
+int mqtt_cmd_mac_to_addr(const mqtt_cmd_str_t * mac, uint8_t * addr) {
+	int stride;
+	if (mac->len == 17) { // aa:bb:cc:dd:ee:ff
+		stride = 3;
+	} else if (mac->len == 12) { // aabbccddeeff
+		stride = 2;
+	} else {
+		return 0;
+	}
+	for (int n = 0; n < 6; n++) {
+		const char * p = mac->ptr + n * stride;
+		int hi = hex_nibble(p[0]), lo = hex_nibble(p[1]);
+		if (hi < 0 || lo < 0 || (stride == 3 && n < 5 && p[2] != ':' && p[2] != '-')) {
+			return 0;
+		}
+		addr[5 - n] = (uint8_t) ((hi << 4) | lo); // addr_str() prints addr[5] first
+	}
+	return 1;
+}
+
+typedef struct {
+	const char * name;
+	uint8_t len;
+} mqtt_action_t;
+
+#define MQTT_ACTION_ENTRY(name, fn, first, middle) { name, sizeof(name) - 1 },
+static const mqtt_action_t mqtt_actions[] = { MQTT_ACTION_LIST(MQTT_ACTION_ENTRY) };
+
+#define MQTT_ACTION_SLOTS 32 // power of 2
+#define MQTT_ACTION_HASH(len, first, middle) (((len) + (uint8_t) (first) + (uint8_t) (middle)) & (MQTT_ACTION_SLOTS - 1))
+
+#define MQTT_ACTION_SLOT(name, fn, first, middle) [MQTT_ACTION_HASH(sizeof(name) - 1, first, middle)] = fn##_id + 1,
+static const uint8_t mqtt_action_slot[MQTT_ACTION_SLOTS] = { MQTT_ACTION_LIST(MQTT_ACTION_SLOT) }; // index + 1 of mqtt_actions, 0: empty
+
+// Not called, a duplicate case value is a compile error where a duplicate designator would silently replace a slot
+#define MQTT_ACTION_CASE(name, fn, first, middle) case MQTT_ACTION_HASH(sizeof(name) - 1, first, middle):
+static void __attribute__((unused)) mqtt_action_hash_check(int h) {
+	switch (h) {
+	MQTT_ACTION_LIST(MQTT_ACTION_CASE)
+		break;
+	}
+}
+
+int mqtt_action_find(const mqtt_cmd_str_t * action) {
+	if (action->len == 0) {
+		return -1;
+	}
+	uint8_t slot = mqtt_action_slot[MQTT_ACTION_HASH(action->len, action->ptr[0], action->ptr[action->len / 2])];
+	if (slot == 0) {
+		return -1;
+	}
+	const mqtt_action_t * entry = &mqtt_actions[slot - 1];
+	if (entry->len == action->len && memcmp(entry->name, action->ptr, action->len) == 0) {
+		return slot - 1;
+	}
+	return -1;
+}
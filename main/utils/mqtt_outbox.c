@@ -0,0 +1,132 @@
+/*
+ * Latest value outbox. While the broker is unreachable, each device keeps only the newest payload of each of its
+ * values, and a reconnect publishes those once instead of replaying every update queued in the MQTT client. Memory
+ * is fixed at SSM_MAX_NUM * MQTT_VALUE_NUM payloads however long the outage is.
+ */
+
+#include "mqtt_outbox.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "mqtt_section.h"
+#include "ssm_timer.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char * TAG = "mqtt_outbox.c";
+
+#define MQTT_OUTBOX_PAYLOAD_MAX 256
+#define MQTT_OUTBOX_RETRY_MS 2000 // a publish failed while connected, e.g. the client outbox was full
+
+typedef struct {
+	const char * suffix;
+	mqtt_msg_class_t msg_class;
+} mqtt_value_info_t;
+
+static const mqtt_value_info_t mqtt_value_info[MQTT_VALUE_NUM] = {
+	[MQTT_VALUE_STATE] = { "state", MQTT_CLASS_STATE },
+	[MQTT_VALUE_RSSI] = { "state/rssi", MQTT_CLASS_TELEMETRY },
+	[MQTT_VALUE_RSSI_STATS] = { "state/rssi_stats", MQTT_CLASS_TELEMETRY },
+};
+
+typedef struct {
+	uint8_t pending; // bit per mqtt_value_t
+	char payload[MQTT_VALUE_NUM][MQTT_OUTBOX_PAYLOAD_MAX];
+} mqtt_outbox_t;
+
+static mqtt_outbox_t outbox[SSM_MAX_NUM];
+static volatile uint8_t broker_connected = 0;
+static SemaphoreHandle_t outbox_lock = NULL;
+
+static void mqtt_outbox_lock(void) {
+	xSemaphoreTake(outbox_lock, portMAX_DELAY);
+}
+
+static void mqtt_outbox_unlock(void) {
+	xSemaphoreGive(outbox_lock);
+}
+
+static int mqtt_outbox_ready(void) {
+	return broker_connected && !mqtt_starting(); // mqtt_start() publishes the status of every device when it is done
+}
+
+// outbox_lock is held, so a kept value can't overtake a newer one
+static int mqtt_outbox_send(sesame * ssm, mqtt_value_t value, const char * payload) {
+	char topic[80];
+	snprintf(topic, sizeof(topic), "homeassistant/%s/%s", ssm->topic, mqtt_value_info[value].suffix);
+	return mqtt_publish(topic, payload, mqtt_value_info[value].msg_class);
+}
+
+void mqtt_outbox_init(void) {
+	if (outbox_lock == NULL) {
+		outbox_lock = xSemaphoreCreateMutex();
+	}
+}
+
+static void mqtt_outbox_flush_cb(void * arg) {
+	mqtt_outbox_flush();
+}
+
+int mqtt_publish_value(sesame * ssm, mqtt_value_t value, const char * payload) {
+	int idx = (struct ssm_env_tag *) ssm - p_ssms_env; // sesame is the first member of ssm_env_tag
+	if (idx < 0 || idx >= SSM_MAX_NUM || value >= MQTT_VALUE_NUM || outbox_lock == NULL) {
+		return -1;
+	}
+	mqtt_outbox_t * box = &outbox[idx];
+	int msg_id = 0;
+	mqtt_outbox_lock();
+	if (mqtt_outbox_ready()) {
+		msg_id = mqtt_outbox_send(ssm, value, payload);
+		box->pending &= ~(1u << value); // older than this one
+	}
+	if (msg_id == 0 && !mqtt_outbox_ready()) { // not sent or QoS 0 sent while the link went down
+		msg_id = -1;
+	}
+	if (msg_id < 0) {
+		if (strlen(payload) < MQTT_OUTBOX_PAYLOAD_MAX) {
+			strcpy(box->payload[value], payload); // replaces the value kept before
+			box->pending |= 1u << value;
+			msg_id = 0;
+			if (mqtt_outbox_ready()) { // no reconnect will flush it
+				ssm_timer_start(mqtt_outbox_flush_cb, NULL, MQTT_OUTBOX_RETRY_MS, 0);
+			}
+		} else {
+			ESP_LOGW(TAG, "%s of %s is too long to keep", mqtt_value_info[value].suffix, ssm->topic);
+		}
+	}
+	mqtt_outbox_unlock();
+	return msg_id;
+}
+
+void mqtt_outbox_connected(uint8_t connected) {
+	broker_connected = connected;
+	if (connected) {
+		ssm_timer_start(mqtt_outbox_flush_cb, NULL, 0, 0); // not in the MQTT event task
+	}
+}
+
+void mqtt_outbox_flush(void) {
+	int cnt = 0;
+	int left = 0;
+	if (outbox_lock == NULL) {
+		return;
+	}
+	mqtt_outbox_lock();
+	for (int n = 0; n < SSM_MAX_NUM && mqtt_outbox_ready(); n++) {
+		mqtt_outbox_t * box = &outbox[n];
+		for (int value = 0; value < MQTT_VALUE_NUM; value++) {
+			if ((box->pending & (1u << value)) && mqtt_outbox_send(&(p_ssms_env + n)->ssm, value, box->payload[value]) >= 0) {
+				box->pending &= ~(1u << value);
+				cnt++;
+			}
+		}
+		left |= box->pending;
+	}
+	if (left && mqtt_outbox_ready()) { // failed again while connected, a disconnect flushes after the reconnect instead
+		ssm_timer_start(mqtt_outbox_flush_cb, NULL, MQTT_OUTBOX_RETRY_MS, 0);
+	}
+	mqtt_outbox_unlock();
+	if (cnt) {
+		ESP_LOGI(TAG, "published %d values kept while the broker was away", cnt);
+	}
+}
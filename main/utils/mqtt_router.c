@@ -0,0 +1,70 @@
+/*
+ * Route incoming MQTT command topics to devices. The topic of a device is "s2m" followed by its address in hex, see
+ * ssm_read_nvs(), so the address is decoded straight from the topic and looked up in a small open addressing table.
+ */
+
+#include "mqtt_router.h"
+#include "esp_log.h"
+#include <string.h>
+
+static const char * TAG = "mqtt_router.c";
+
+#define ROUTER_PREFIX "homeassistant/s2m"
+#define ROUTER_SUFFIX "/set"
+#define ROUTER_SLOTS (SSM_MAX_NUM * 2) // power of 2, at most half full
+
+static sesame * router_slot[ROUTER_SLOTS];
+
+static uint8_t router_hash(const uint8_t * addr) {
+	return (addr[0] ^ addr[3] ^ addr[5]) & (ROUTER_SLOTS - 1);
+}
+
+static int hex_nibble(char c) {
+	if (c >= '0' && c <= '9') {
+		return c - '0';
+	} else if (c >= 'a' && c <= 'f') {
+		return c - 'a' + 10;
+	} else if (c >= 'A' && c <= 'F') {
+		return c - 'A' + 10;
+	}
+	return -1;
+}
+
+void mqtt_router_add(sesame * ssm) {
+	uint8_t h = router_hash(ssm->addr);
+	for (int n = 0; n < ROUTER_SLOTS; n++, h = (h + 1) & (ROUTER_SLOTS - 1)) {
+		if (router_slot[h] == ssm || router_slot[h] == NULL) {
+			router_slot[h] = ssm;
+			return;
+		}
+	}
+	ESP_LOGE(TAG, "router table is full, %s is not routed", ssm->topic);
+}
+
+sesame * mqtt_router_find(const char * topic, int topic_len) {
+	const int prefix_len = sizeof(ROUTER_PREFIX) - 1, suffix_len = sizeof(ROUTER_SUFFIX) - 1;
+	uint8_t addr[6];
+
+	if (topic == NULL || topic_len < prefix_len + 12 + suffix_len || memcmp(topic, ROUTER_PREFIX, prefix_len) != 0) {
+		return NULL;
+	}
+	const char * p = topic + prefix_len;
+	for (int n = 0; n < 6; n++, p += 2) {
+		int hi = hex_nibble(p[0]), lo = hex_nibble(p[1]);
+		if (hi < 0 || lo < 0) {
+			return NULL;
+		}
+		addr[n] = (uint8_t) ((hi << 4) | lo);
+	}
+	if (memcmp(p, ROUTER_SUFFIX, suffix_len) != 0 || (topic_len > prefix_len + 12 + suffix_len && p[suffix_len] != '/')) {
+		return NULL; // not homeassistant/s2mxxxxxxxxxxxx/set or homeassistant/s2mxxxxxxxxxxxx/set/...
+	}
+
+	uint8_t h = router_hash(addr);
+	for (int n = 0; n < ROUTER_SLOTS && router_slot[h] != NULL; n++, h = (h + 1) & (ROUTER_SLOTS - 1)) {
+		if (memcmp(router_slot[h]->addr, addr, sizeof(addr)) == 0) {
+			return router_slot[h];
+		}
+	}
+	return NULL;
+}
@@ -19,6 +19,7 @@
 #include <string.h>
 
 #include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
 #include "freertos/queue.h"
 #include "freertos/semphr.h"
 #include "freertos/task.h"
@@ -31,52 +32,105 @@
 #include "esp_central.h"
 #include "esp_log.h"
 #include "mqtt_client.h"
+#include "mqtt_cmd.h"
+#include "mqtt_outbox.h"
+#include "mqtt_router.h"
 #include "mqtt_section.h"
+#include "ssm_boot.h"
 #include "ssm_cmd.h"
+#include "ssm_conn.h"
+#include "ssm_log.h"
+#include "ssm_sup.h"
+#include "ssm_timer.h"
+#include "wifi_section.h"
 
 static const char * TAG = "mqtt_section.c";
 
+#define MQTT_EVENT_BIT_CONNECTED BIT0 // mqtt_init_done was set
+#define MQTT_EVENT_BIT_PUBLISHED BIT1 // msg_id_subscribed was updated
+static EventGroupHandle_t mqtt_events = NULL;
+
+#define MQTT_START_STACK_SIZE 6144
+#define MQTT_START_PRIORITY (tskIDLE_PRIORITY + 2)
+static volatile uint8_t mqtt_start_pending = 0; // mqtt_start() is waiting for the broker
+static volatile uint8_t sync_requested = 0;
+static SemaphoreHandle_t sync_lock = NULL;
+
 esp_mqtt_client_handle_t client_ssm;
 int mqtt_init_done = 0;
 int msg_id_subscribed = 0;
 char config_broker_url[60] = {};
 uint8_t cnt_HA_devices = 0;
 
+#ifndef CONFIG_SSM_MQTT_RETAIN_STATE
+#define CONFIG_SSM_MQTT_RETAIN_STATE 0
+#endif
+#ifndef CONFIG_SSM_MQTT_RETAIN_TELEMETRY
+#define CONFIG_SSM_MQTT_RETAIN_TELEMETRY 0
+#endif
+
+const mqtt_qos_policy_t mqtt_qos_policy[MQTT_CLASS_NUM] = {
+	[MQTT_CLASS_STATE] = { CONFIG_SSM_MQTT_QOS_STATE, CONFIG_SSM_MQTT_RETAIN_STATE },
+	[MQTT_CLASS_TELEMETRY] = { CONFIG_SSM_MQTT_QOS_TELEMETRY, CONFIG_SSM_MQTT_RETAIN_TELEMETRY },
+	[MQTT_CLASS_CONFIG] = { CONFIG_SSM_MQTT_QOS_CONFIG, 1 }, // discovery config is always retained
+	[MQTT_CLASS_COMMAND] = { CONFIG_SSM_MQTT_QOS_COMMAND, 0 },
+};
+
+#define MQTT_WILDCARD_COMMAND_TOPIC "homeassistant/+/set/#" // command topics of all devices, routed by mqtt_router_find()
+
 static void log_error_if_nonzero(const char * message, int error_code) {
 	if (error_code != 0) {
 		ESP_LOGE(TAG, "Last error %s: 0x%x", message, error_code);
 	}
 }
 
-double get_json_value(char * data, int * quote_index, int id1, int id2) {
-	char * ptr = data + quote_index[id1] + 1;
-	int len = quote_index[id2] - quote_index[id1] - 1;
-	char str[30];
-	strncpy(str, ptr, len);
-	return atof(str);
+int mqtt_publish(const char * topic, const char * payload, mqtt_msg_class_t msg_class) {
+	if (client_ssm == NULL) { // mqtt_start() wasn't called yet
+		return -1;
+	}
+	return esp_mqtt_client_publish(client_ssm, topic, payload, 0, mqtt_qos_policy[msg_class].qos, mqtt_qos_policy[msg_class].retain);
 }
 
-void get_json_str(char * data, int * quote_index, int id1, int id2, char * str) {
-	char * ptr = data + quote_index[id1] + 1;
-	int len = quote_index[id2] - quote_index[id1] - 1;
-	strncpy(str, ptr, len);
-	for (; *str; ++str)
-		*str = tolower(*str);
+int mqtt_publish_status(sesame * ssm) {
+	const char * state = NULL; // state_locked, state_unlocked and state_jammed of the lock entity
+	if (ssm->device_status == SSM_LOCKED) {
+		state = "LOCK";
+	} else if (ssm->device_status == SSM_UNLOCKED) {
+		state = "UNLOCK";
+	} else if (ssm->device_status == SSM_MOVED) { // neither in the lock nor in the unlock range
+		state = "JAMMED";
+	}
+	char payload[160];
+	int cnt = 0;
+	cnt += sprintf(payload + cnt, "{");
+	if (state != NULL) {
+		cnt += sprintf(payload + cnt, "\"state\": \"%s\", ", state);
+	}
+	cnt += sprintf(payload + cnt, "\"battery\": %d, ", (int) ssm->battery_percentage);
+	cnt += sprintf(payload + cnt, "\"position\": %d, ", ssm->mech_status.position);
+	cnt += sprintf(payload + cnt, "\"lock_position\": %d, ", ssm->mech.lock_unlock.lock);
+	cnt += sprintf(payload + cnt, "\"unlock_position\": %d}", ssm->mech.lock_unlock.unlock);
+	int msg_id = mqtt_publish_value(ssm, MQTT_VALUE_STATE, payload); // kept while the broker is away
+	ESP_LOGI(TAG, "sent mqtt state for %s, msg_id=%d", ssm->topic, msg_id);
+	return msg_id;
 }
 
 int wait_published(int msg_id) {
-	int n_max = 30; // wait at most 3 secs
+	if (msg_id <= 0) { // QoS 0 is never acknowledged, -1 is a failed publish
+		return msg_id == 0;
+	}
+	int64_t deadline_us = ssm_timer_now_us() + 3000000; // wait at most 3 secs
 	int subscribed = 0;
-	for (int n = 0; n < n_max; n++) {
+	while (mqtt_events != NULL) {
 		if (msg_id == msg_id_subscribed) {
 			subscribed = 1;
 			break;
-		} else {
-			//if (loop_timeout()) {
-			//	break;
-			//}
-			vTaskDelay(100 / portTICK_PERIOD_MS);
 		}
+		int64_t left_us = deadline_us - ssm_timer_now_us();
+		if (left_us <= 0) {
+			break;
+		}
+		xEventGroupWaitBits(mqtt_events, MQTT_EVENT_BIT_PUBLISHED, pdTRUE, pdFALSE, pdMS_TO_TICKS(left_us / 1000) + 1); // woken by every PUBLISHED event
 	}
 	if (subscribed) {
 		ESP_LOGI(TAG, "published msg_id = %d", msg_id);
@@ -88,11 +142,171 @@ int wait_published(int msg_id) {
 }
 
 int wake_up(sesame * ssm) {
-	ssm->update_status = 0;
+	ssm_conn_clear(ssm, SSM_CONN_EVENT_STATUS); // wait for the status sent after this reconnect
 	reconnect(ssm);
 	return wait_for_status_update(ssm, 10);
 }
 
+static int find_ssm_by_mac(const mqtt_cmd_t * cmd, sesame ** ssm) {
+	uint8_t addr[6] = {};
+	if (!mqtt_cmd_mac_to_addr(&cmd->mac, addr)) {
+		return 0;
+	}
+	for (int n = 0; n < cnt_ssms; n++) {
+		if (memcmp(addr, (p_ssms_env + n)->ssm.addr, sizeof(addr)) == 0) {
+			*ssm = &(p_ssms_env + n)->ssm;
+			ESP_LOGI(TAG, "Sesame with mac %s is found", addr_str(addr));
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// Touch commands, sent by ssm_conn_run() as soon as the Touch is logged in
+static void conn_cmd_finger_add(sesame * tch, sesame * peer) {
+	tch->add_finger = 1;
+	tch_finger_add(tch);
+}
+
+static void conn_cmd_finger_verify(sesame * tch, sesame * peer) {
+	tch->add_finger = 0;
+	tch_finger_verify(tch);
+}
+
+static void conn_cmd_card_add(sesame * tch, sesame * peer) {
+	tch->add_card = 1;
+	tch_card_add(tch);
+}
+
+static void conn_cmd_card_verify(sesame * tch, sesame * peer) {
+	tch->add_card = 0;
+	tch_card_verify(tch);
+}
+
+static void mqtt_action_lock(sesame * ssm, sesame * tch, const mqtt_cmd_t * cmd) {
+	ssm_lock(ssm, NULL, 0);
+}
+
+static void mqtt_action_unlock(sesame * ssm, sesame * tch, const mqtt_cmd_t * cmd) {
+	ssm_unlock(ssm, NULL, 0);
+}
+
+static void mqtt_action_magnet(sesame * ssm, sesame * tch, const mqtt_cmd_t * cmd) {
+	ssm_magnet(ssm);
+}
+
+static void mqtt_action_gen_qr_code_text(sesame * ssm, sesame * tch, const mqtt_cmd_t * cmd) {
+	int msg_id;
+	char topic[80] = "";
+	char qr[120] = "";
+	(ssm == NULL) ? (ssm = tch) : (tch = ssm);
+	sprintf(topic, "homeassistant/%s/state/qr_code_text", ssm->topic); // config topic
+	gen_qr_code_txt(ssm, qr);
+	msg_id = esp_mqtt_client_publish(client_ssm, topic, qr, 0, mqtt_qos_policy[MQTT_CLASS_STATE].qos, 0); // never retain the device secret on the broker
+	ESP_LOGI(TAG, "sent mqtt qr code text for %s, msg_id=%d", ssm->topic, msg_id);
+}
+
+static void mqtt_action_add_sesame(sesame * ssm, sesame * tch, const mqtt_cmd_t * cmd) {
+	ESP_LOGI(TAG, "Request to add sesame with mac %.*s", cmd->mac.len, cmd->mac.ptr);
+	if (find_ssm_by_mac(cmd, &ssm)) {
+		if (ssm_conn_run(tch, tch_add_sesame, ssm, 10)) {
+			ESP_LOGI(TAG, "Add sesame with mac = %s", addr_str(ssm->addr));
+			vTaskDelay(200 / portTICK_PERIOD_MS);
+		}
+	}
+	disconnect(tch);
+}
+
+static void mqtt_action_remove_sesame(sesame * ssm, sesame * tch, const mqtt_cmd_t * cmd) {
+	ESP_LOGI(TAG, "Request to remove sesame with mac %.*s", cmd->mac.len, cmd->mac.ptr);
+	if (find_ssm_by_mac(cmd, &ssm)) {
+		if (ssm_conn_run(tch, tch_remove_sesame, ssm, 10)) {
+			ESP_LOGI(TAG, "Remove sesame with mac = %s", addr_str(ssm->addr));
+			vTaskDelay(200 / portTICK_PERIOD_MS);
+		}
+	}
+	disconnect(tch);
+}
+
+static void mqtt_action_add_finger(sesame * ssm, sesame * tch, const mqtt_cmd_t * cmd) {
+	ESP_LOGI(TAG, "change to add finger mode");
+	if (ssm_conn_run(tch, conn_cmd_finger_add, NULL, 10)) {
+		ESP_LOGI(TAG, "start add finger mode");
+	}
+}
+
+static void mqtt_action_verify_finger(sesame * ssm, sesame * tch, const mqtt_cmd_t * cmd) {
+	ESP_LOGI(TAG, "change to verify finger mode");
+	if (ssm_conn_run(tch, conn_cmd_finger_verify, NULL, 10)) {
+		vTaskDelay(200 / portTICK_PERIOD_MS);
+	}
+	disconnect(tch);
+}
+
+static void mqtt_action_add_card(sesame * ssm, sesame * tch, const mqtt_cmd_t * cmd) {
+	ESP_LOGI(TAG, "change to add card mode");
+	if (ssm_conn_run(tch, conn_cmd_card_add, NULL, 10)) {
+		ESP_LOGI(TAG, "start add card mode");
+	}
+}
+
+static void mqtt_action_verify_card(sesame * ssm, sesame * tch, const mqtt_cmd_t * cmd) {
+	ESP_LOGI(TAG, "change to verify card mode");
+	if (ssm_conn_run(tch, conn_cmd_card_verify, NULL, 10)) {
+		vTaskDelay(200 / portTICK_PERIOD_MS);
+	}
+	disconnect(tch);
+}
+
+static void mqtt_action_disconnect_touch(sesame * ssm, sesame * tch, const mqtt_cmd_t * cmd) {
+	ESP_LOGI(TAG, "disconnect touch");
+	disconnect(tch);
+}
+
+static void mqtt_action_reconnect_touch(sesame * ssm, sesame * tch, const mqtt_cmd_t * cmd) {
+	ESP_LOGI(TAG, "reconnect touch");
+	wake_up(tch);
+}
+
+static void mqtt_action_set_lock_position(sesame * ssm, sesame * tch, const mqtt_cmd_t * cmd) {
+	if (!cmd->has_position) {
+		ESP_LOGW(TAG, "lock position is missing");
+		return;
+	}
+	ssm->mech.lock_unlock.lock = cmd->position;
+	ESP_LOGI(TAG, "set lock position to %d", ssm->mech.lock_unlock.lock);
+	ssm_mech(ssm, ssm->mech.lock_unlock.lock, ssm->mech.lock_unlock.unlock);
+}
+
+static void mqtt_action_set_unlock_position(sesame * ssm, sesame * tch, const mqtt_cmd_t * cmd) {
+	if (!cmd->has_position) {
+		ESP_LOGW(TAG, "unlock position is missing");
+		return;
+	}
+	ssm->mech.lock_unlock.unlock = cmd->position;
+	ESP_LOGI(TAG, "set unlock position to %d", ssm->mech.lock_unlock.unlock);
+	ssm_mech(ssm, ssm->mech.lock_unlock.lock, ssm->mech.lock_unlock.unlock);
+}
+
+static void mqtt_action_battery_update(sesame * ssm, sesame * tch, const mqtt_cmd_t * cmd) {
+	ESP_LOGI(TAG, "touch battery update");
+	if (wake_up(tch)) {
+		ESP_LOGI(TAG, "touch battery update done");
+	} else {
+		ESP_LOGW(TAG, "touch battery update fail");
+	}
+	disconnect(tch);
+}
+
+static void mqtt_action_dump_log(sesame * ssm, sesame * tch, const mqtt_cmd_t * cmd) {
+	ssm_log_dump();
+}
+
+typedef void (*mqtt_action_fn)(sesame * ssm, sesame * tch, const mqtt_cmd_t * cmd);
+
+#define MQTT_ACTION_HANDLER(name, fn, first, middle) fn,
+static const mqtt_action_fn mqtt_action_handlers[] = { MQTT_ACTION_LIST(MQTT_ACTION_HANDLER) }; // indexed by mqtt_action_find()
+
 /*
  * @brief Event handler registered to receive MQTT events
  *
@@ -116,14 +330,23 @@ static void mqtt_event_handler(void * handler_args, esp_event_base_t base, int32
 		//if (mqtt_init_done) { // if MQTT broker disconnect and reconnect, reboot ESP. Currently I don't know a better way to solve it without reboot 20240522 by JS
 		//	esp_restart();
 		//}
+#if CONFIG_SSM_MQTT_WILDCARD_SUBSCRIBE
+		if (!event->session_present) { // a persistent session keeps the subscription
+			int msg_id = esp_mqtt_client_subscribe(client_ssm, MQTT_WILDCARD_COMMAND_TOPIC, mqtt_qos_policy[MQTT_CLASS_COMMAND].qos);
+			ESP_LOGI(TAG, "sent subscribe for %s, msg_id=%d", MQTT_WILDCARD_COMMAND_TOPIC, msg_id);
+		}
+#endif
 		mqtt_init_done = 1;
+		mqtt_outbox_connected(1);
+		xEventGroupSetBits(mqtt_events, MQTT_EVENT_BIT_CONNECTED);
 		break;
 	case MQTT_EVENT_DISCONNECTED:
 		ESP_LOGI(TAG, "MQTT_EVENT_DISCONNECTED");
+		mqtt_outbox_connected(0);
 		break;
 
 	case MQTT_EVENT_SUBSCRIBED:
-		ESP_LOGI(TAG, "MQTT_EVENT_SUBSCRIBED, msg_id=%d", event->msg_id);
+		SSM_LOG(SSM_EV_MQTT_SUBSCRIBED, event->msg_id, 0, 0, 0);
 		// msg_id = esp_mqtt_client_publish(client, "/topic/qos0", "data", 0, 0, 0);
 		// ESP_LOGI(TAG, "sent publish successful, msg_id=%d", msg_id);
 		break;
@@ -131,211 +354,36 @@ static void mqtt_event_handler(void * handler_args, esp_event_base_t base, int32
 		ESP_LOGI(TAG, "MQTT_EVENT_UNSUBSCRIBED, msg_id=%d", event->msg_id);
 		break;
 	case MQTT_EVENT_PUBLISHED:
-		ESP_LOGI(TAG, "MQTT_EVENT_PUBLISHED, msg_id=%d", event->msg_id);
+		SSM_LOG(SSM_EV_MQTT_PUBLISHED, event->msg_id, 0, 0, 0);
 		msg_id_subscribed = event->msg_id;
+		xEventGroupSetBits(mqtt_events, MQTT_EVENT_BIT_PUBLISHED);
 		break;
 	case MQTT_EVENT_DATA:
-		ESP_LOGI(TAG, "MQTT_EVENT_DATA");
-		printf("TOPIC=%.*s\r\n", event->topic_len, event->topic);
-		printf("DATA=%.*s\r\n", event->data_len, event->data);
-		printf("QoS= %d, retain=%d\r\n", event->qos, event->retain);
-
 		// find ssm
 		sesame *ssm = NULL, *tch = NULL;
-		char topic[80] = "";
-		// char empty_payload[2] = "";
-		uint8_t valid = 0;
-		for (int n = 0; n < cnt_ssms; n++) {
-			memset(topic, 0, sizeof(topic));
-			sprintf(topic, "homeassistant/%s/set", (p_ssms_env + n)->ssm.topic); // command topic
-			ESP_LOGI(TAG, "topic = %s", topic);
-			ESP_LOGI(TAG, "event->topic = %s", event->topic);
-			if (strncmp(event->topic, topic, strlen(topic)) == 0) {
-				valid = 1;
-				if ((p_ssms_env + n)->ssm.product_type == SESAME_TOUCH || (p_ssms_env + n)->ssm.product_type == SESAME_TOUCH_PRO) {
-					tch = &(p_ssms_env + n)->ssm;
-				} else {
-					ssm = &(p_ssms_env + n)->ssm;
-				}
-				break;
-			}
+		sesame * dev = mqtt_router_find(event->topic, event->topic_len);
+		uint8_t valid = (dev != NULL);
+		SSM_LOG(SSM_EV_MQTT_DATA, valid ? dev->product_type : 0, event->data_len, event->qos, event->retain);
+		if (dev == NULL) {
+			ESP_LOGD(TAG, "no device for topic %.*s", event->topic_len, event->topic); // not ours if subscribed by wildcard
+		} else if (dev->product_type == SESAME_TOUCH || dev->product_type == SESAME_TOUCH_PRO) {
+			tch = dev;
+		} else {
+			ssm = dev;
 		}
 
 		if (valid) {
-			int quote_index[16] = { 0 };
-			int i_quote = 0;
-			char * action;
-			int action_len = 0;
-
-			for (int n = 0; n < event->data_len; n++) {
-				if (event->data[n] == '"') {
-					quote_index[i_quote++] = n;
-				}
-			}
-
-			if (i_quote == 0) {
-				action = event->data;
-				action_len = event->data_len;
-			} else {
-				action = event->data + quote_index[2] + 1;
-				action_len = quote_index[3] - quote_index[2] - 1;
-			}
-			ESP_LOGI(TAG, "action_len = %d", action_len);
-
-			if (action_len == strlen("lock") && strncmp(action, "lock", strlen("lock")) == 0) {
-				ssm_lock(ssm, NULL, 0);
-				return;
-			}
-			if (action_len == strlen("unlock") && strncmp(action, "unlock", strlen("unlock")) == 0) {
-				ssm_unlock(ssm, NULL, 0);
-				return;
-			}
-			if (action_len == strlen("magnet") && strncmp(action, "magnet", strlen("magnet")) == 0) {
-				ssm_magnet(ssm);
-				return;
-			}
-			if (action_len == strlen("gen_qr_code_text") && strncmp(action, "gen_qr_code_text", strlen("gen_qr_code_text")) == 0) {
-				int msg_id;
-				(ssm == NULL) ? (ssm = tch) : (tch = ssm);
-				memset(topic, 0, sizeof(topic));
-				sprintf(topic, "homeassistant/%s/state/qr_code_text", ssm->topic); // config topic
-				char qr[120] = "";
-				gen_qr_code_txt(ssm, qr);
-				msg_id = esp_mqtt_client_publish(client_ssm, topic, qr, 0, 2, 0); // QOS 2, retain 1
-				ESP_LOGI(TAG, "sent mqtt qr code text for %s, msg_id=%d", ssm->topic, msg_id);
-			}
-			if (action_len == strlen("add_sesame") && strncmp(action, "add_sesame", strlen("add_sesame")) == 0) {
-				int found = 0;
-				char addr[20] = {};
-				get_json_str(event->data, quote_index, 6, 7, addr);
-				ESP_LOGI(TAG, "Request to add sesame with mac %s", addr);
-				for (int n = 0; n < cnt_ssms; n++) {
-					memset(topic, 0, sizeof(topic));
-					ESP_LOGI(TAG, "addr = %s", addr_str((p_ssms_env + n)->ssm.addr));
-					if (strncmp(addr, addr_str((p_ssms_env + n)->ssm.addr), 17) == 0) {
-						found = 1;
-						ssm = &(p_ssms_env + n)->ssm;
-						ESP_LOGI(TAG, "Sesame with mac %s is found", addr);
-					}
-				}
-
-				if (found) {
-					if (wake_up(tch)) {
-						tch_add_sesame(tch, ssm);
-						ESP_LOGI(TAG, "Add sesame with mac = %s", addr);
-						vTaskDelay(200 / portTICK_PERIOD_MS);
-						// int msg_id = 0;
-						// memset(topic, 0, sizeof(topic));
-						// sprintf(topic, "homeassistant/%s/state/add_sesame", ssm->topic); // config topic
-						// msg_id = esp_mqtt_client_publish(client_ssm, topic, empty_payload, 0, 2, 0); // QOS 2, retain 1
-						// ESP_LOGI(TAG, "sent \"\" for add_sesame for %s, msg_id=%d", ssm->topic, msg_id);
-						// wait_published(msg_id);
-					}
-				}
-				disconnect(tch);
-				return;
-			}
-			if (action_len == strlen("remove_sesame") && strncmp(action, "remove_sesame", strlen("remove_sesame")) == 0) {
-				int found = 0;
-				char addr[20] = {};
-				get_json_str(event->data, quote_index, 6, 7, addr);
-				ESP_LOGI(TAG, "Request to remove sesame with mac %s", addr);
-				for (int n = 0; n < cnt_ssms; n++) {
-					memset(topic, 0, sizeof(topic));
-					ESP_LOGI(TAG, "addr = %s", addr_str((p_ssms_env + n)->ssm.addr));
-					if (strncmp(addr, addr_str((p_ssms_env + n)->ssm.addr), 17) == 0) {
-						found = 1;
-						ssm = &(p_ssms_env + n)->ssm;
-						ESP_LOGI(TAG, "Sesame with mac %s is found", addr);
-					}
-				}
-
-				if (found) {
-					if (wake_up(tch)) {
-						tch_remove_sesame(tch, ssm);
-						ESP_LOGI(TAG, "Remove sesame with mac = %s", addr);
-						vTaskDelay(200 / portTICK_PERIOD_MS);
-						// int msg_id = 0;
-						// memset(topic, 0, sizeof(topic));
-						// sprintf(topic, "homeassistant/%s/state/remove_sesame", ssm->topic); // config topic
-						// msg_id = esp_mqtt_client_publish(client_ssm, topic, empty_payload, 0, 2, 0); // QOS 2, retain 1
-						// ESP_LOGI(TAG, "sent \"\" for remove_sesame for %s, msg_id=%d", ssm->topic, msg_id);
-						// wait_published(msg_id);
-					}
-				}
-				disconnect(tch);
-				return;
-			}
-			if (action_len == strlen("add_finger") && strncmp(action, "add_finger", strlen("add_finger")) == 0) {
-				ESP_LOGI(TAG, "change to add finger mode");
-				if (wake_up(tch)) {
-					tch->add_finger = 1;
-					tch_finger_add(tch);
-					ESP_LOGI(TAG, "start add finger mode");
-				}
-				return;
-			}
-			if (action_len == strlen("verify_finger") && strncmp(action, "verify_finger", strlen("verify_finger")) == 0) {
-				ESP_LOGI(TAG, "change to verify finger mode");
-				if (wake_up(tch)) {
-					tch->add_finger = 0;
-					tch_finger_verify(tch);
-					vTaskDelay(200 / portTICK_PERIOD_MS);
-				}
-				disconnect(tch);
-				return;
-			}
-			if (action_len == strlen("add_card") && strncmp(action, "add_card", strlen("add_card")) == 0) {
-				ESP_LOGI(TAG, "change to add card mode");
-				if (wake_up(tch)) {
-					tch->add_card = 1;
-					tch_card_add(tch);
-					ESP_LOGI(TAG, "start add card mode");
-				}
-				return;
-			}
-			if (action_len == strlen("verify_card") && strncmp(action, "verify_card", strlen("verify_card")) == 0) {
-				ESP_LOGI(TAG, "change to verify card mode");
-				if (wake_up(tch)) {
-					tch->add_card = 0;
-					tch_card_verify(tch);
-					vTaskDelay(200 / portTICK_PERIOD_MS);
-				}
-				disconnect(tch);
-				return;
-			}
-			if (action_len == strlen("disconnect_touch") && strncmp(action, "disconnect_touch", strlen("disconnect_touch")) == 0) {
-				ESP_LOGI(TAG, "disconnect touch");
-				disconnect(tch);
-				return;
-			}
-			if (action_len == strlen("reconnect_touch") && strncmp(action, "reconnect_touch", strlen("reconnect_touch")) == 0) {
-				ESP_LOGI(TAG, "reconnect touch");
-				wake_up(tch);
-				return;
-			}
-			if (action_len == strlen("set_lock_position") && strncmp(action, "set_lock_position", strlen("set_lock_position")) == 0) {
-				ssm->mech.lock_unlock.lock = (int) get_json_value(event->data, quote_index, 6, 7);
-				ESP_LOGI(TAG, "set lock position to %d", ssm->mech.lock_unlock.lock);
-				ssm_mech(ssm, ssm->mech.lock_unlock.lock, ssm->mech.lock_unlock.unlock);
-				return;
-			}
-			if (action_len == strlen("set_unlock_position") && strncmp(action, "set_unlock_position", strlen("set_unlock_position")) == 0) {
-				ssm->mech.lock_unlock.unlock = (int) get_json_value(event->data, quote_index, 6, 7);
-				ESP_LOGI(TAG, "set unlock position to %d", ssm->mech.lock_unlock.unlock);
-				ssm_mech(ssm, ssm->mech.lock_unlock.lock, ssm->mech.lock_unlock.unlock);
-				return;
+			mqtt_cmd_t cmd;
+			if (!mqtt_cmd_parse(event->data, event->data_len, &cmd)) {
+				ESP_LOGW(TAG, "invalid command payload %.*s", event->data_len, event->data);
+				break;
 			}
-			if (action_len == strlen("battery_update") && strncmp(action, "battery_update", strlen("battery_update")) == 0) {
-				ESP_LOGI(TAG, "touch battery update");
-				if (wake_up(tch)) {
-					ESP_LOGI(TAG, "touch battery update done");
-				} else {
-					ESP_LOGW(TAG, "touch battery update fail");
-				}
-				disconnect(tch);
-				return;
+			int action = mqtt_action_find(&cmd.action);
+			if (action < 0) {
+				ESP_LOGW(TAG, "unknown action %.*s", cmd.action.len, cmd.action.ptr);
+				break;
 			}
+			mqtt_action_handlers[action](ssm, tch, &cmd);
 		}
 		break;
 	case MQTT_EVENT_ERROR:
@@ -386,7 +434,7 @@ void mqtt_discovery(void) {
 			cnt += sprintf(payload + cnt, "\"state_jammed\": \"JAMMED\",\n");
 			cnt += sprintf(payload + cnt, "\"value_template\": \"{{ value_json.state }}\",\n");
 			cnt += sprintf(payload + cnt, "\"optimistic\": false,\n");
-			cnt += sprintf(payload + cnt, "\"qos\": 2,\n");
+			cnt += sprintf(payload + cnt, "\"qos\": %d,\n", mqtt_qos_policy[MQTT_CLASS_COMMAND].qos);
 			cnt += sprintf(payload + cnt, "\"retain\": false,\n");
 			cnt += sprintf(payload + cnt, "\"dev\": {\n");
 			// cnt += sprintf(payload + cnt, "\"ids\": \"%s\",\n", secret);
@@ -399,7 +447,7 @@ void mqtt_discovery(void) {
 			ESP_LOGI(TAG, "max payload = %d", cnt);
 			memset(topic, 0, sizeof(topic));
 			sprintf(topic, "homeassistant/lock/%s/config", ssm->topic);			   // config topic
-			msg_id = esp_mqtt_client_publish(client_ssm, topic, payload, 0, 2, 1); // QOS 2, retain 1
+			msg_id = mqtt_publish(topic, payload, MQTT_CLASS_CONFIG);
 			ESP_LOGI(TAG, "sent mqtt lock config for %s, msg_id=%d", ssm->topic, msg_id);
 			wait_published(msg_id);
 
@@ -425,7 +473,7 @@ void mqtt_discovery(void) {
 			cnt += sprintf(payload + cnt, "}");
 			memset(topic, 0, sizeof(topic));
 			sprintf(topic, "homeassistant/sensor/%s_battery/config", ssm->topic);  // config topic
-			msg_id = esp_mqtt_client_publish(client_ssm, topic, payload, 0, 2, 1); // QOS 2, retain 1
+			msg_id = mqtt_publish(topic, payload, MQTT_CLASS_CONFIG);
 			ESP_LOGI(TAG, "sent mqtt battery config for %s, msg_id=%d", ssm->topic, msg_id);
 			wait_published(msg_id);
 
@@ -451,7 +499,7 @@ void mqtt_discovery(void) {
 			cnt += sprintf(payload + cnt, "}");
 			memset(topic, 0, sizeof(topic));
 			sprintf(topic, "homeassistant/sensor/%s_position/config", ssm->topic); // config topic
-			msg_id = esp_mqtt_client_publish(client_ssm, topic, payload, 0, 2, 1); // QOS 2, retain 1
+			msg_id = mqtt_publish(topic, payload, MQTT_CLASS_CONFIG);
 			ESP_LOGI(TAG, "sent mqtt position config for %s, msg_id=%d", ssm->topic, msg_id);
 			wait_published(msg_id);
 
@@ -472,7 +520,7 @@ void mqtt_discovery(void) {
 			cnt += sprintf(payload + cnt, "\"mode\": \"box\",\n");
 			cnt += sprintf(payload + cnt, "\"max\": 540,\n");
 			cnt += sprintf(payload + cnt, "\"min\": -180,\n");
-			cnt += sprintf(payload + cnt, "\"qos\": 2,\n");
+			cnt += sprintf(payload + cnt, "\"qos\": %d,\n", mqtt_qos_policy[MQTT_CLASS_COMMAND].qos);
 			cnt += sprintf(payload + cnt, "\"retain\": true,\n");
 			cnt += sprintf(payload + cnt, "\"dev\": {\n");
 			// cnt += sprintf(payload + cnt, "\"ids\": \"%s\",\n", secret);
@@ -484,7 +532,7 @@ void mqtt_discovery(void) {
 			cnt += sprintf(payload + cnt, "}");
 			memset(topic, 0, sizeof(topic));
 			sprintf(topic, "homeassistant/number/%s_lock_position/config", ssm->topic); // config topic
-			msg_id = esp_mqtt_client_publish(client_ssm, topic, payload, 0, 2, 1);		// QOS 2, retain 1
+			msg_id = mqtt_publish(topic, payload, MQTT_CLASS_CONFIG);
 			ESP_LOGI(TAG, "sent mqtt lock_position config for %s, msg_id=%d", ssm->topic, msg_id);
 			wait_published(msg_id);
 
@@ -505,7 +553,7 @@ void mqtt_discovery(void) {
 			cnt += sprintf(payload + cnt, "\"mode\": \"box\",\n");
 			cnt += sprintf(payload + cnt, "\"max\": 540,\n");
 			cnt += sprintf(payload + cnt, "\"min\": -180,\n");
-			cnt += sprintf(payload + cnt, "\"qos\": 2,\n");
+			cnt += sprintf(payload + cnt, "\"qos\": %d,\n", mqtt_qos_policy[MQTT_CLASS_COMMAND].qos);
 			cnt += sprintf(payload + cnt, "\"retain\": true,\n");
 			cnt += sprintf(payload + cnt, "\"dev\": {\n");
 			// cnt += sprintf(payload + cnt, "\"ids\": \"%s\",\n", secret);
@@ -517,7 +565,7 @@ void mqtt_discovery(void) {
 			cnt += sprintf(payload + cnt, "}");
 			memset(topic, 0, sizeof(topic));
 			sprintf(topic, "homeassistant/number/%s_unlock_position/config", ssm->topic); // config topic
-			msg_id = esp_mqtt_client_publish(client_ssm, topic, payload, 0, 2, 1);		  // QOS 2, retain 1
+			msg_id = mqtt_publish(topic, payload, MQTT_CLASS_CONFIG);
 			ESP_LOGI(TAG, "sent mqtt unlock_position config for %s, msg_id=%d", ssm->topic, msg_id);
 			wait_published(msg_id);
 
@@ -533,7 +581,7 @@ void mqtt_discovery(void) {
 			cnt += sprintf(payload + cnt, "\"cmd_t\": \"~/set\",\n");
 			cnt += sprintf(payload + cnt, "\"cmd_tpl\": \"{ \\\"action\\\": \\\"magnet\\\" }\",\n");
 			cnt += sprintf(payload + cnt, "\"unit_of_measurement\": \"\",\n");
-			cnt += sprintf(payload + cnt, "\"qos\": 2,\n");
+			cnt += sprintf(payload + cnt, "\"qos\": %d,\n", mqtt_qos_policy[MQTT_CLASS_COMMAND].qos);
 			cnt += sprintf(payload + cnt, "\"retain\": false,\n");
 			cnt += sprintf(payload + cnt, "\"dev\": {\n");
 			// cnt += sprintf(payload + cnt, "\"ids\": \"%s\",\n", secret);
@@ -545,7 +593,7 @@ void mqtt_discovery(void) {
 			cnt += sprintf(payload + cnt, "}");
 			memset(topic, 0, sizeof(topic));
 			sprintf(topic, "homeassistant/button/%s_horizon_calibration/config", ssm->topic); // config topic
-			msg_id = esp_mqtt_client_publish(client_ssm, topic, payload, 0, 2, 1);			  // QOS 2, retain 1
+			msg_id = mqtt_publish(topic, payload, MQTT_CLASS_CONFIG);
 			ESP_LOGI(TAG, "sent mqtt horizon calibration config for %s, msg_id=%d", ssm->topic, msg_id);
 			wait_published(msg_id);
 
@@ -563,7 +611,7 @@ void mqtt_discovery(void) {
 			cnt += sprintf(payload + cnt, "\"stat_t\": \"~/state/qr_code_text\",\n");
 			cnt += sprintf(payload + cnt, "\"unit_of_measurement\": \"\",\n");
 			cnt += sprintf(payload + cnt, "\"optimistic\": false,\n");
-			cnt += sprintf(payload + cnt, "\"qos\": 2,\n");
+			cnt += sprintf(payload + cnt, "\"qos\": %d,\n", mqtt_qos_policy[MQTT_CLASS_COMMAND].qos);
 			cnt += sprintf(payload + cnt, "\"retain\": false,\n");
 			cnt += sprintf(payload + cnt, "\"dev\": {\n");
 			// cnt += sprintf(payload + cnt, "\"ids\": \"%s\",\n", secret);
@@ -575,7 +623,7 @@ void mqtt_discovery(void) {
 			cnt += sprintf(payload + cnt, "}");
 			memset(topic, 0, sizeof(topic));
 			sprintf(topic, "homeassistant/text/%s_qr_code_text/config", ssm->topic); // config topic
-			msg_id = esp_mqtt_client_publish(client_ssm, topic, payload, 0, 2, 1);	 // QOS 2, retain 1
+			msg_id = mqtt_publish(topic, payload, MQTT_CLASS_CONFIG);
 			ESP_LOGI(TAG, "sent mqtt qr code text config for %s, msg_id=%d", ssm->topic, msg_id);
 			wait_published(msg_id);
 
@@ -591,7 +639,7 @@ void mqtt_discovery(void) {
 			cnt += sprintf(payload + cnt, "\"cmd_t\": \"~/set\",\n");
 			cnt += sprintf(payload + cnt, "\"cmd_tpl\": \"{ \\\"action\\\": \\\"gen_qr_code_text\\\" }\",\n");
 			cnt += sprintf(payload + cnt, "\"unit_of_measurement\": \"\",\n");
-			cnt += sprintf(payload + cnt, "\"qos\": 2,\n");
+			cnt += sprintf(payload + cnt, "\"qos\": %d,\n", mqtt_qos_policy[MQTT_CLASS_COMMAND].qos);
 			cnt += sprintf(payload + cnt, "\"retain\": false,\n");
 			cnt += sprintf(payload + cnt, "\"dev\": {\n");
 			// cnt += sprintf(payload + cnt, "\"ids\": \"%s\",\n", secret);
@@ -603,7 +651,7 @@ void mqtt_discovery(void) {
 			cnt += sprintf(payload + cnt, "}");
 			memset(topic, 0, sizeof(topic));
 			sprintf(topic, "homeassistant/button/%s_gen_qr_code_text/config", ssm->topic); // config topic
-			msg_id = esp_mqtt_client_publish(client_ssm, topic, payload, 0, 2, 1);		   // QOS 2, retain 1
+			msg_id = mqtt_publish(topic, payload, MQTT_CLASS_CONFIG);
 			ESP_LOGI(TAG, "sent mqtt gen qr code text config for %s, msg_id=%d", ssm->topic, msg_id);
 			wait_published(msg_id);
 		} else if (ssm->product_type == SESAME_TOUCH || ssm->product_type == SESAME_TOUCH_PRO) {
@@ -629,7 +677,7 @@ void mqtt_discovery(void) {
 			cnt += sprintf(payload + cnt, "}");
 			memset(topic, 0, sizeof(topic));
 			sprintf(topic, "homeassistant/sensor/%s_battery/config", ssm->topic);  // config topic
-			msg_id = esp_mqtt_client_publish(client_ssm, topic, payload, 0, 2, 1); // QOS 2, retain 1
+			msg_id = mqtt_publish(topic, payload, MQTT_CLASS_CONFIG);
 			ESP_LOGI(TAG, "sent mqtt battery config for %s, msg_id=%d", ssm->topic, msg_id);
 			wait_published(msg_id);
 
@@ -758,7 +806,7 @@ void mqtt_discovery(void) {
 			cnt += sprintf(payload + cnt, "\"stat_t\": \"~/state/add_sesame\",\n");
 			cnt += sprintf(payload + cnt, "\"unit_of_measurement\": \"\",\n");
 			cnt += sprintf(payload + cnt, "\"optimistic\": false,\n");
-			cnt += sprintf(payload + cnt, "\"qos\": 2,\n");
+			cnt += sprintf(payload + cnt, "\"qos\": %d,\n", mqtt_qos_policy[MQTT_CLASS_COMMAND].qos);
 			cnt += sprintf(payload + cnt, "\"retain\": false,\n");
 			cnt += sprintf(payload + cnt, "\"dev\": {\n");
 			// cnt += sprintf(payload + cnt, "\"ids\": \"%s\",\n", secret);
@@ -770,7 +818,7 @@ void mqtt_discovery(void) {
 			cnt += sprintf(payload + cnt, "}");
 			memset(topic, 0, sizeof(topic));
 			sprintf(topic, "homeassistant/text/%s_add_sesame/config", ssm->topic); // config topic
-			msg_id = esp_mqtt_client_publish(client_ssm, topic, payload, 0, 2, 1); // QOS 2, retain 1
+			msg_id = mqtt_publish(topic, payload, MQTT_CLASS_CONFIG);
 			ESP_LOGI(TAG, "sent mqtt add sesame config for %s, msg_id=%d", ssm->topic, msg_id);
 			wait_published(msg_id);
 
@@ -788,7 +836,7 @@ void mqtt_discovery(void) {
 			cnt += sprintf(payload + cnt, "\"stat_t\": \"~/state/remove_sesame\",\n");
 			cnt += sprintf(payload + cnt, "\"unit_of_measurement\": \"\",\n");
 			cnt += sprintf(payload + cnt, "\"optimistic\": false,\n");
-			cnt += sprintf(payload + cnt, "\"qos\": 2,\n");
+			cnt += sprintf(payload + cnt, "\"qos\": %d,\n", mqtt_qos_policy[MQTT_CLASS_COMMAND].qos);
 			cnt += sprintf(payload + cnt, "\"retain\": false,\n");
 			cnt += sprintf(payload + cnt, "\"dev\": {\n");
 			// cnt += sprintf(payload + cnt, "\"ids\": \"%s\",\n", secret);
@@ -800,7 +848,7 @@ void mqtt_discovery(void) {
 			cnt += sprintf(payload + cnt, "}");
 			memset(topic, 0, sizeof(topic));
 			sprintf(topic, "homeassistant/text/%s_remove_sesame/config", ssm->topic); // config topic
-			msg_id = esp_mqtt_client_publish(client_ssm, topic, payload, 0, 2, 1);	  // QOS 2, retain 1
+			msg_id = mqtt_publish(topic, payload, MQTT_CLASS_CONFIG);
 			ESP_LOGI(TAG, "sent mqtt remove sesame config for %s, msg_id=%d", ssm->topic, msg_id);
 			wait_published(msg_id);
 
@@ -819,7 +867,7 @@ void mqtt_discovery(void) {
 			// cnt += sprintf(payload + cnt, "\"value_template\": \"{{ value_json.connect }}\",\n");
 			cnt += sprintf(payload + cnt, "\"unit_of_measurement\": \"\",\n");
 			cnt += sprintf(payload + cnt, "\"optimistic\": false,\n");
-			cnt += sprintf(payload + cnt, "\"qos\": 2,\n");
+			cnt += sprintf(payload + cnt, "\"qos\": %d,\n", mqtt_qos_policy[MQTT_CLASS_COMMAND].qos);
 			cnt += sprintf(payload + cnt, "\"retain\": false,\n");
 			cnt += sprintf(payload + cnt, "\"dev\": {\n");
 			// cnt += sprintf(payload + cnt, "\"ids\": \"%s\",\n", secret);
@@ -831,7 +879,7 @@ void mqtt_discovery(void) {
 			cnt += sprintf(payload + cnt, "}");
 			memset(topic, 0, sizeof(topic));
 			sprintf(topic, "homeassistant/text/%s_qr_code_text/config", ssm->topic); // config topic
-			msg_id = esp_mqtt_client_publish(client_ssm, topic, payload, 0, 2, 1);	 // QOS 2, retain 1
+			msg_id = mqtt_publish(topic, payload, MQTT_CLASS_CONFIG);
 			ESP_LOGI(TAG, "sent mqtt qr code text config for %s, msg_id=%d", ssm->topic, msg_id);
 			wait_published(msg_id);
 
@@ -847,7 +895,7 @@ void mqtt_discovery(void) {
 			cnt += sprintf(payload + cnt, "\"cmd_t\": \"~/set\",\n");
 			cnt += sprintf(payload + cnt, "\"cmd_tpl\": \"{ \\\"action\\\": \\\"gen_qr_code_text\\\" }\",\n");
 			cnt += sprintf(payload + cnt, "\"unit_of_measurement\": \"\",\n");
-			cnt += sprintf(payload + cnt, "\"qos\": 2,\n");
+			cnt += sprintf(payload + cnt, "\"qos\": %d,\n", mqtt_qos_policy[MQTT_CLASS_COMMAND].qos);
 			cnt += sprintf(payload + cnt, "\"retain\": false,\n");
 			cnt += sprintf(payload + cnt, "\"dev\": {\n");
 			// cnt += sprintf(payload + cnt, "\"ids\": \"%s\",\n", secret);
@@ -859,7 +907,7 @@ void mqtt_discovery(void) {
 			cnt += sprintf(payload + cnt, "}");
 			memset(topic, 0, sizeof(topic));
 			sprintf(topic, "homeassistant/button/%s_gen_qr_code_text/config", ssm->topic); // config topic
-			msg_id = esp_mqtt_client_publish(client_ssm, topic, payload, 0, 2, 1);		   // QOS 2, retain 1
+			msg_id = mqtt_publish(topic, payload, MQTT_CLASS_CONFIG);
 			ESP_LOGI(TAG, "sent mqtt gen qr code text config for %s, msg_id=%d", ssm->topic, msg_id);
 			wait_published(msg_id);
 
@@ -875,7 +923,7 @@ void mqtt_discovery(void) {
 			cnt += sprintf(payload + cnt, "\"cmd_t\": \"~/set\",\n");
 			cnt += sprintf(payload + cnt, "\"cmd_tpl\": \"{ \\\"action\\\": \\\"battery_update\\\" }\",\n");
 			cnt += sprintf(payload + cnt, "\"unit_of_measurement\": \"\",\n");
-			cnt += sprintf(payload + cnt, "\"qos\": 2,\n");
+			cnt += sprintf(payload + cnt, "\"qos\": %d,\n", mqtt_qos_policy[MQTT_CLASS_COMMAND].qos);
 			cnt += sprintf(payload + cnt, "\"retain\": false,\n");
 			cnt += sprintf(payload + cnt, "\"dev\": {\n");
 			// cnt += sprintf(payload + cnt, "\"ids\": \"%s\",\n", secret);
@@ -887,7 +935,7 @@ void mqtt_discovery(void) {
 			cnt += sprintf(payload + cnt, "}");
 			memset(topic, 0, sizeof(topic));
 			sprintf(topic, "homeassistant/button/%s_battery_update/config", ssm->topic); // config topic
-			msg_id = esp_mqtt_client_publish(client_ssm, topic, payload, 0, 2, 1);		 // QOS 2, retain 1
+			msg_id = mqtt_publish(topic, payload, MQTT_CLASS_CONFIG);
 			ESP_LOGI(TAG, "sent mqtt battery update config for %s, msg_id=%d", ssm->topic, msg_id);
 			wait_published(msg_id);
 		}
@@ -902,6 +950,7 @@ void mqtt_discovery(void) {
 		cnt += sprintf(payload + cnt, "\"name\": \"RSSI\",\n");
 		cnt += sprintf(payload + cnt, "\"uniq_id\": \"%s_rssi\",\n", ssm->topic);
 		cnt += sprintf(payload + cnt, "\"stat_t\": \"~/state/rssi\",\n");
+		cnt += sprintf(payload + cnt, "\"json_attr_t\": \"~/state/rssi_stats\",\n"); // EWMA, min/max and percentiles of the last minute
 		//cnt += sprintf(payload + cnt, "\"value_template\": \"{{ value_json.battery }}\",\n");
 		cnt += sprintf(payload + cnt, "\"unit_of_measurement\": \"dBm\",\n");
 		cnt += sprintf(payload + cnt, "\"dev\": {\n");
@@ -914,7 +963,7 @@ void mqtt_discovery(void) {
 		cnt += sprintf(payload + cnt, "}");
 		memset(topic, 0, sizeof(topic));
 		sprintf(topic, "homeassistant/sensor/%s_rssi/config", ssm->topic);  // config topic
-		msg_id = esp_mqtt_client_publish(client_ssm, topic, payload, 0, 2, 1); // QOS 2, retain 1
+		msg_id = mqtt_publish(topic, payload, MQTT_CLASS_CONFIG);
 		ESP_LOGI(TAG, "sent mqtt rssi config for %s, msg_id=%d", ssm->topic, msg_id);
 		wait_published(msg_id); 
 
@@ -938,9 +987,12 @@ void mqtt_subscribe(void) {
 			msg_id = esp_mqtt_client_publish(client_ssm, topic, NULL, 0, 0, 1); // QOS 0, retain 1
 			ESP_LOGI(TAG, "clear retained message for %s, msg_id=%d", topic, msg_id);
 		}
-		msg_id = esp_mqtt_client_subscribe(client_ssm, topic, 2); // QOS 2
+		mqtt_router_add(ssm); // route the command topics of this device
+#if !CONFIG_SSM_MQTT_WILDCARD_SUBSCRIBE
+		msg_id = esp_mqtt_client_subscribe(client_ssm, topic, mqtt_qos_policy[MQTT_CLASS_COMMAND].qos);
 		ESP_LOGI(TAG, "sent subscribe for %s, msg_id=%d", ssm->topic, msg_id);
 		// wait_published(msg_id);
+#endif
 
 		memset(topic, 0, sizeof(topic));
 		sprintf(topic, "homeassistant/%s/state", ssm->topic);					// command topic
@@ -952,7 +1004,7 @@ void mqtt_subscribe(void) {
 		// set empty default value for qr code test for both Sesame Lock and Touch
 		memset(topic, 0, sizeof(topic));
 		sprintf(topic, "homeassistant/%s/state/qr_code_text", ssm->topic);			 // config topic
-		msg_id = esp_mqtt_client_publish(client_ssm, topic, empty_payload, 0, 2, 0); // QOS 2, retain 1
+		msg_id = mqtt_publish(topic, empty_payload, MQTT_CLASS_STATE);
 		ESP_LOGI(TAG, "sent \"\" for qr_code_text for %s, msg_id=%d", ssm->topic, msg_id);
 		//wait_published(msg_id);
 
@@ -963,9 +1015,11 @@ void mqtt_subscribe(void) {
 				msg_id = esp_mqtt_client_publish(client_ssm, topic, NULL, 0, 0, 1); // QOS 0, retain 1
 				ESP_LOGI(TAG, "clear retained message for %s, msg_id=%d", ssm->topic, msg_id);
 			}
-			msg_id = esp_mqtt_client_subscribe(client_ssm, topic, 2); // QOS 2
+#if !CONFIG_SSM_MQTT_WILDCARD_SUBSCRIBE
+			msg_id = esp_mqtt_client_subscribe(client_ssm, topic, mqtt_qos_policy[MQTT_CLASS_COMMAND].qos);
 			ESP_LOGI(TAG, "sent subscribe for %s, msg_id=%d", ssm->topic, msg_id);
 			// wait_published(msg_id);
+#endif
 
 			memset(topic, 0, sizeof(topic));
 			sprintf(topic, "homeassistant/%s/set/unlock_position", ssm->topic);		// command topic
@@ -973,21 +1027,23 @@ void mqtt_subscribe(void) {
 				msg_id = esp_mqtt_client_publish(client_ssm, topic, NULL, 0, 0, 1); // QOS 0, retain 1
 				ESP_LOGI(TAG, "clear retained message for %s, msg_id=%d", ssm->topic, msg_id);
 			}
-			msg_id = esp_mqtt_client_subscribe(client_ssm, topic, 2); // QOS 2
+#if !CONFIG_SSM_MQTT_WILDCARD_SUBSCRIBE
+			msg_id = esp_mqtt_client_subscribe(client_ssm, topic, mqtt_qos_policy[MQTT_CLASS_COMMAND].qos);
 			ESP_LOGI(TAG, "sent subscribe for %s, msg_id=%d", ssm->topic, msg_id);
 			// wait_published(msg_id);
+#endif
 		} else {
 			// set empty default value for add_sesame for Touch
 			memset(topic, 0, sizeof(topic));
 			sprintf(topic, "homeassistant/%s/state/add_sesame", ssm->topic);			 // config topic
-			msg_id = esp_mqtt_client_publish(client_ssm, topic, empty_payload, 0, 2, 0); // QOS 2, retain 1
+			msg_id = mqtt_publish(topic, empty_payload, MQTT_CLASS_STATE);
 			ESP_LOGI(TAG, "sent \"\" for add_sesame for %s, msg_id=%d", ssm->topic, msg_id);
 			//wait_published(msg_id);
 
 			// set empty default value for remove_sesame for Touch
 			memset(topic, 0, sizeof(topic));
 			sprintf(topic, "homeassistant/%s/state/remove_sesame", ssm->topic);			 // config topic
-			msg_id = esp_mqtt_client_publish(client_ssm, topic, empty_payload, 0, 2, 0); // QOS 2, retain 1
+			msg_id = mqtt_publish(topic, empty_payload, MQTT_CLASS_STATE);
 			ESP_LOGI(TAG, "sent \"\" for remove_sesame for %s, msg_id=%d", ssm->topic, msg_id);
 			//wait_published(msg_id);
 		}
@@ -1035,6 +1091,10 @@ static void mqtt_app_start(bool disable_clean_session) {
 	}
 #endif /* CONFIG_BROKER_URL_FROM_STDIN */
 
+	if (mqtt_events == NULL) {
+		mqtt_events = xEventGroupCreate();
+	}
+	xEventGroupClearBits(mqtt_events, MQTT_EVENT_BIT_CONNECTED);
 	// esp_mqtt_client_handle_t client = esp_mqtt_client_init(&mqtt_cfg);
 	client_ssm = esp_mqtt_client_init(&mqtt_cfg);
 	/* The last argument may be used to pass data to the event handler, in this example mqtt_event_handler */
@@ -1042,29 +1102,92 @@ static void mqtt_app_start(bool disable_clean_session) {
 	esp_mqtt_client_start(client_ssm);
 }
 
-void mqtt_start(void) {
-	mqtt_app_start(false); // first MQTT start with clean_session enabled
-	for (int n = 0; n < 600; n++) { // timeout after 60 seconds
-		if (mqtt_init_done) {
-			ESP_LOGI(TAG, "MQTT clean session init done. Takes %f seconds", n * 0.1);
-			break;
+static int mqtt_wait_connected(const char * session) {
+	int64_t t_start_us = ssm_timer_now_us();
+	xEventGroupWaitBits(mqtt_events, MQTT_EVENT_BIT_CONNECTED, pdFALSE, pdFALSE, pdMS_TO_TICKS(60000)); // timeout after 60 seconds
+	if (mqtt_init_done) {
+		ESP_LOGI(TAG, "MQTT %s session init done. Takes %f seconds", session, (ssm_timer_now_us() - t_start_us) / 1e6);
+	}
+	return mqtt_init_done;
+}
+
+static void mqtt_start_session(bool persistent) { // recreate the client with backoff until the broker accepts it
+	ssm_backoff_t backoff = {};
+	for (;;) {
+		mqtt_app_start(persistent);
+		if (mqtt_wait_connected(persistent ? "persistent" : "clean")) {
+			ssm_boot_mark(persistent ? SSM_BOOT_MQTT_READY : SSM_BOOT_MQTT_CLEAN);
+			return;
 		}
-		vTaskDelay(100 / portTICK_PERIOD_MS);
+		esp_mqtt_client_destroy(client_ssm);
+		client_ssm = NULL;
+		if (CONFIG_SSM_MQTT_RETRY_LIMIT > 0 && backoff.failures + 1 >= CONFIG_SSM_MQTT_RETRY_LIMIT) {
+			ssm_boot_save_warm(NULL); // start with a clean session again, the stored one may be what fails
+			ssm_sup_restart("MQTT broker unreachable");
+		}
+		uint32_t delay_ms = ssm_backoff_next(&backoff, 1000);
+		ESP_LOGW(TAG, "MQTT connect failed, retry %u in %lu ms", backoff.failures, (unsigned long) delay_ms);
+		vTaskDelay(pdMS_TO_TICKS(delay_ms));
+	}
+}
+
+void mqtt_start(void) {
+	if (sync_lock == NULL) {
+		sync_lock = xSemaphoreCreateMutex();
+	}
+	mqtt_start_pending = 1;
+#if CONFIG_SSM_WARM_START
+	int warm = ssm_boot_warm(config_broker_url);
+#else
+	int warm = 0;
+#endif
+	if (warm) { // the broker keeps our persistent session and subscription from the last boot
+		mqtt_start_session(true);
+	} else {
+		mqtt_start_session(false); // first MQTT start with clean_session enabled
+		esp_mqtt_client_destroy(client_ssm);
+		client_ssm = NULL;
+		mqtt_init_done = false;
+		mqtt_start_session(true); // 2nd MQTT start with clean_session disabled
+#if CONFIG_SSM_WARM_START
+		ssm_boot_save_warm(config_broker_url);
+#endif
 	}
-	if (!mqtt_init_done) {
-		esp_restart();
-	} 
-	esp_mqtt_client_destroy(client_ssm);
-	mqtt_init_done = false;
-	mqtt_app_start(true); // 2nd MQTT start with clean_session disabled
-	for (int n = 0; n < 600; n++) { // timeout after 60 seconds
-		if (mqtt_init_done) {
-			ESP_LOGI(TAG, "MQTT persistent session init done. Takes %f seconds", n * 0.1);
+	mqtt_start_pending = 0;
+	mqtt_sync_devices(); // the devices logged in while the broker was not ready
+	mqtt_outbox_flush();
+}
+
+static void mqtt_start_task(void * param) {
+	wifi_init_sta();
+	mqtt_start();
+	vTaskDelete(NULL);
+}
+
+void mqtt_start_background(void) {
+	mqtt_start_pending = 1; // hold back device status from now on, not only once the task runs
+	if (xTaskCreate(mqtt_start_task, "mqtt_start", MQTT_START_STACK_SIZE, NULL, MQTT_START_PRIORITY, NULL) != pdPASS) {
+		ESP_LOGE(TAG, "[mqtt_start_background][FAIL]");
+		wifi_init_sta();
+		mqtt_start();
+	}
+}
+
+int mqtt_starting(void) {
+	return mqtt_start_pending;
+}
+
+void mqtt_sync_devices(void) {
+	sync_requested = 1;
+	while (!mqtt_start_pending && sync_requested && (sync_lock == NULL || xSemaphoreTake(sync_lock, 0) == pdTRUE)) { // the BLE host task doesn't wait, the holder runs again for it
+		while (sync_requested) {
+			sync_requested = 0;
+			mqtt_discovery();
+			mqtt_subscribe();
+		}
+		if (sync_lock == NULL) {
 			break;
 		}
-		vTaskDelay(100 / portTICK_PERIOD_MS);
-	}
-	if (!mqtt_init_done) {
-		esp_restart();
+		xSemaphoreGive(sync_lock);
 	}
 }
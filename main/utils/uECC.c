@@ -159,6 +159,18 @@ struct uECC_Curve_t
 #endif
 };
 
+#define uECC_SECP256R1_ONLY (uECC_SUPPORTS_secp256r1 && !uECC_SUPPORTS_secp160r1 && !uECC_SUPPORTS_secp192r1 && !uECC_SUPPORTS_secp224r1 && !uECC_SUPPORTS_secp256k1)
+
+/* CURVE(curve) is the curve the code works on. In a secp256r1-only build it is the constant
+   curve_secp256r1 whatever is passed in, so num_words, p and n fold to constants and
+   mmod_fast / double_jacobian / x_side are direct calls that can be inlined. */
+#if uECC_SECP256R1_ONLY
+static const struct uECC_Curve_t curve_secp256r1;
+#define CURVE(curve) (&curve_secp256r1)
+#else
+#define CURVE(curve) (curve)
+#endif
+
 #if uECC_VLI_NATIVE_LITTLE_ENDIAN
 
 static void __bocpy(uint8_t * dst, const uint8_t * src, unsigned num_bytes)
@@ -182,6 +194,14 @@ static cmpresult_t uECC_vli_cmp_unsafe(const uECC_word_t * left, const uECC_word
 #include "asm_avr.inc"
 #endif
 
+#if (uECC_PLATFORM == uECC_riscv)
+#include "asm_riscv.inc"
+#endif
+
+#if (uECC_PLATFORM == uECC_xtensa)
+#include "asm_xtensa.inc"
+#endif
+
 #if default_RNG_defined
 static uECC_RNG_Function g_rng_function = &default_RNG;
 #else
@@ -195,12 +215,12 @@ void uECC_set_rng(uECC_RNG_Function rng_function)
 
 int uECC_curve_private_key_size(uECC_Curve curve)
 {
-    return BITS_TO_BYTES(curve->num_n_bits);
+    return BITS_TO_BYTES(CURVE(curve)->num_n_bits);
 }
 
 int uECC_curve_public_key_size(uECC_Curve curve)
 {
-    return 2 * curve->num_bytes;
+    return 2 * CURVE(curve)->num_bytes;
 }
 
 #if !asm_clear
@@ -412,6 +432,13 @@ static void muladd(uECC_word_t a, uECC_word_t b, uECC_word_t * r0, uECC_word_t *
     p0 = (i0 & 0xffffffffull) | (i2 << 32);
     p1 = i3 + (i2 >> 32);
 
+    *r0 += p0;
+    *r1 += (p1 + (*r0 < p0));
+    *r2 += ((*r1 < p1) || (*r1 == p1 && *r0 < p0));
+#elif defined(uECC_mulhi)
+    uECC_word_t p0 = a * b;
+    uECC_word_t p1 = uECC_mulhi(a, b);
+
     *r0 += p0;
     *r1 += (p1 + (*r0 < p0));
     *r2 += ((*r1 < p1) || (*r1 == p1 && *r0 < p0));
@@ -496,6 +523,17 @@ static void mul2add(uECC_word_t a, uECC_word_t b, uECC_word_t * r0, uECC_word_t
     p1 = (p1 << 1) | (p0 >> 63);
     p0 <<= 1;
 
+    *r0 += p0;
+    *r1 += (p1 + (*r0 < p0));
+    *r2 += ((*r1 < p1) || (*r1 == p1 && *r0 < p0));
+#elif defined(uECC_mulhi)
+    uECC_word_t p0 = a * b;
+    uECC_word_t p1 = uECC_mulhi(a, b);
+
+    *r2 += (p1 >> (uECC_WORD_BITS - 1));
+    p1 = (p1 << 1) | (p0 >> (uECC_WORD_BITS - 1));
+    p0 <<= 1;
+
     *r0 += p0;
     *r1 += (p1 + (*r0 < p0));
     *r2 += ((*r1 < p1) || (*r1 == p1 && *r0 < p0));
@@ -639,11 +677,11 @@ uECC_VLI_API void uECC_vli_modMult(uECC_word_t * result, const uECC_word_t * lef
 uECC_VLI_API void uECC_vli_modMult_fast(uECC_word_t * result, const uECC_word_t * left, const uECC_word_t * right, uECC_Curve curve)
 {
     uECC_word_t product[2 * uECC_MAX_WORDS];
-    uECC_vli_mult(product, left, right, curve->num_words);
+    uECC_vli_mult(product, left, right, CURVE(curve)->num_words);
 #if (uECC_OPTIMIZATION_LEVEL > 0)
-    curve->mmod_fast(result, product);
+    CURVE(curve)->mmod_fast(result, product);
 #else
-    uECC_vli_mmod(result, product, curve->p, curve->num_words);
+    uECC_vli_mmod(result, product, CURVE(curve)->p, CURVE(curve)->num_words);
 #endif
 }
 
@@ -662,11 +700,11 @@ uECC_VLI_API void uECC_vli_modSquare(uECC_word_t * result, const uECC_word_t * l
 uECC_VLI_API void uECC_vli_modSquare_fast(uECC_word_t * result, const uECC_word_t * left, uECC_Curve curve)
 {
     uECC_word_t product[2 * uECC_MAX_WORDS];
-    uECC_vli_square(product, left, curve->num_words);
+    uECC_vli_square(product, left, CURVE(curve)->num_words);
 #if (uECC_OPTIMIZATION_LEVEL > 0)
-    curve->mmod_fast(result, product);
+    CURVE(curve)->mmod_fast(result, product);
 #else
-    uECC_vli_mmod(result, product, curve->p, curve->num_words);
+    uECC_vli_mmod(result, product, CURVE(curve)->p, CURVE(curve)->num_words);
 #endif
 }
 
@@ -784,7 +822,7 @@ static void apply_z(uECC_word_t * X1, uECC_word_t * Y1, const uECC_word_t * cons
 static void XYcZ_initial_double(uECC_word_t * X1, uECC_word_t * Y1, uECC_word_t * X2, uECC_word_t * Y2, const uECC_word_t * const initial_Z, uECC_Curve curve)
 {
     uECC_word_t z[uECC_MAX_WORDS];
-    wordcount_t num_words = curve->num_words;
+    wordcount_t num_words = CURVE(curve)->num_words;
     if (initial_Z)
     {
         uECC_vli_set(z, initial_Z, num_words);
@@ -799,7 +837,7 @@ static void XYcZ_initial_double(uECC_word_t * X1, uECC_word_t * Y1, uECC_word_t
     uECC_vli_set(Y2, Y1, num_words);
 
     apply_z(X1, Y1, z, curve);
-    curve->double_jacobian(X1, Y1, z, curve);
+    CURVE(curve)->double_jacobian(X1, Y1, z, curve);
     apply_z(X2, Y2, z, curve);
 }
 
@@ -811,22 +849,22 @@ static void XYcZ_add(uECC_word_t * X1, uECC_word_t * Y1, uECC_word_t * X2, uECC_
 {
     /* t1 = X1, t2 = Y1, t3 = X2, t4 = Y2 */
     uECC_word_t t5[uECC_MAX_WORDS];
-    wordcount_t num_words = curve->num_words;
+    wordcount_t num_words = CURVE(curve)->num_words;
 
-    uECC_vli_modSub(t5, X2, X1, curve->p, num_words); /* t5 = x2 - x1 */
+    uECC_vli_modSub(t5, X2, X1, CURVE(curve)->p, num_words); /* t5 = x2 - x1 */
     uECC_vli_modSquare_fast(t5, t5, curve);           /* t5 = (x2 - x1)^2 = A */
     uECC_vli_modMult_fast(X1, X1, t5, curve);         /* t1 = x1*A = B */
     uECC_vli_modMult_fast(X2, X2, t5, curve);         /* t3 = x2*A = C */
-    uECC_vli_modSub(Y2, Y2, Y1, curve->p, num_words); /* t4 = y2 - y1 */
+    uECC_vli_modSub(Y2, Y2, Y1, CURVE(curve)->p, num_words); /* t4 = y2 - y1 */
     uECC_vli_modSquare_fast(t5, Y2, curve);           /* t5 = (y2 - y1)^2 = D */
 
-    uECC_vli_modSub(t5, t5, X1, curve->p, num_words); /* t5 = D - B */
-    uECC_vli_modSub(t5, t5, X2, curve->p, num_words); /* t5 = D - B - C = x3 */
-    uECC_vli_modSub(X2, X2, X1, curve->p, num_words); /* t3 = C - B */
+    uECC_vli_modSub(t5, t5, X1, CURVE(curve)->p, num_words); /* t5 = D - B */
+    uECC_vli_modSub(t5, t5, X2, CURVE(curve)->p, num_words); /* t5 = D - B - C = x3 */
+    uECC_vli_modSub(X2, X2, X1, CURVE(curve)->p, num_words); /* t3 = C - B */
     uECC_vli_modMult_fast(Y1, Y1, X2, curve);         /* t2 = y1*(C - B) */
-    uECC_vli_modSub(X2, X1, t5, curve->p, num_words); /* t3 = B - x3 */
+    uECC_vli_modSub(X2, X1, t5, CURVE(curve)->p, num_words); /* t3 = B - x3 */
     uECC_vli_modMult_fast(Y2, Y2, X2, curve);         /* t4 = (y2 - y1)*(B - x3) */
-    uECC_vli_modSub(Y2, Y2, Y1, curve->p, num_words); /* t4 = y3 */
+    uECC_vli_modSub(Y2, Y2, Y1, CURVE(curve)->p, num_words); /* t4 = y3 */
 
     uECC_vli_set(X2, t5, num_words);
 }
@@ -841,30 +879,30 @@ static void XYcZ_addC(uECC_word_t * X1, uECC_word_t * Y1, uECC_word_t * X2, uECC
     uECC_word_t t5[uECC_MAX_WORDS];
     uECC_word_t t6[uECC_MAX_WORDS];
     uECC_word_t t7[uECC_MAX_WORDS];
-    wordcount_t num_words = curve->num_words;
+    wordcount_t num_words = CURVE(curve)->num_words;
 
-    uECC_vli_modSub(t5, X2, X1, curve->p, num_words); /* t5 = x2 - x1 */
+    uECC_vli_modSub(t5, X2, X1, CURVE(curve)->p, num_words); /* t5 = x2 - x1 */
     uECC_vli_modSquare_fast(t5, t5, curve);           /* t5 = (x2 - x1)^2 = A */
     uECC_vli_modMult_fast(X1, X1, t5, curve);         /* t1 = x1*A = B */
     uECC_vli_modMult_fast(X2, X2, t5, curve);         /* t3 = x2*A = C */
-    uECC_vli_modAdd(t5, Y2, Y1, curve->p, num_words); /* t5 = y2 + y1 */
-    uECC_vli_modSub(Y2, Y2, Y1, curve->p, num_words); /* t4 = y2 - y1 */
+    uECC_vli_modAdd(t5, Y2, Y1, CURVE(curve)->p, num_words); /* t5 = y2 + y1 */
+    uECC_vli_modSub(Y2, Y2, Y1, CURVE(curve)->p, num_words); /* t4 = y2 - y1 */
 
-    uECC_vli_modSub(t6, X2, X1, curve->p, num_words); /* t6 = C - B */
+    uECC_vli_modSub(t6, X2, X1, CURVE(curve)->p, num_words); /* t6 = C - B */
     uECC_vli_modMult_fast(Y1, Y1, t6, curve);         /* t2 = y1 * (C - B) = E */
-    uECC_vli_modAdd(t6, X1, X2, curve->p, num_words); /* t6 = B + C */
+    uECC_vli_modAdd(t6, X1, X2, CURVE(curve)->p, num_words); /* t6 = B + C */
     uECC_vli_modSquare_fast(X2, Y2, curve);           /* t3 = (y2 - y1)^2 = D */
-    uECC_vli_modSub(X2, X2, t6, curve->p, num_words); /* t3 = D - (B + C) = x3 */
+    uECC_vli_modSub(X2, X2, t6, CURVE(curve)->p, num_words); /* t3 = D - (B + C) = x3 */
 
-    uECC_vli_modSub(t7, X1, X2, curve->p, num_words); /* t7 = B - x3 */
+    uECC_vli_modSub(t7, X1, X2, CURVE(curve)->p, num_words); /* t7 = B - x3 */
     uECC_vli_modMult_fast(Y2, Y2, t7, curve);         /* t4 = (y2 - y1)*(B - x3) */
-    uECC_vli_modSub(Y2, Y2, Y1, curve->p, num_words); /* t4 = (y2 - y1)*(B - x3) - E = y3 */
+    uECC_vli_modSub(Y2, Y2, Y1, CURVE(curve)->p, num_words); /* t4 = (y2 - y1)*(B - x3) - E = y3 */
 
     uECC_vli_modSquare_fast(t7, t5, curve);           /* t7 = (y2 + y1)^2 = F */
-    uECC_vli_modSub(t7, t7, t6, curve->p, num_words); /* t7 = F - (B + C) = x3' */
-    uECC_vli_modSub(t6, t7, X1, curve->p, num_words); /* t6 = x3' - B */
+    uECC_vli_modSub(t7, t7, t6, CURVE(curve)->p, num_words); /* t7 = F - (B + C) = x3' */
+    uECC_vli_modSub(t6, t7, X1, CURVE(curve)->p, num_words); /* t6 = x3' - B */
     uECC_vli_modMult_fast(t6, t6, t5, curve);         /* t6 = (y2+y1)*(x3' - B) */
-    uECC_vli_modSub(Y1, t6, Y1, curve->p, num_words); /* t2 = (y2+y1)*(x3' - B) - E = y3' */
+    uECC_vli_modSub(Y1, t6, Y1, CURVE(curve)->p, num_words); /* t2 = (y2+y1)*(x3' - B) - E = y3' */
 
     uECC_vli_set(X1, t7, num_words);
 }
@@ -878,7 +916,7 @@ static void EccPoint_mult(uECC_word_t * result, const uECC_word_t * point, const
     uECC_word_t z[uECC_MAX_WORDS];
     bitcount_t i;
     uECC_word_t nb;
-    wordcount_t num_words = curve->num_words;
+    wordcount_t num_words = CURVE(curve)->num_words;
 
     uECC_vli_set(Rx[1], point, num_words);
     uECC_vli_set(Ry[1], point + num_words, num_words);
@@ -896,10 +934,10 @@ static void EccPoint_mult(uECC_word_t * result, const uECC_word_t * point, const
     XYcZ_addC(Rx[1 - nb], Ry[1 - nb], Rx[nb], Ry[nb], curve);
 
     /* Find final 1/Z value. */
-    uECC_vli_modSub(z, Rx[1], Rx[0], curve->p, num_words); /* X1 - X0 */
+    uECC_vli_modSub(z, Rx[1], Rx[0], CURVE(curve)->p, num_words); /* X1 - X0 */
     uECC_vli_modMult_fast(z, z, Ry[1 - nb], curve);        /* Yb * (X1 - X0) */
     uECC_vli_modMult_fast(z, z, point, curve);             /* xP * Yb * (X1 - X0) */
-    uECC_vli_modInv(z, z, curve->p, num_words);            /* 1 / (xP * Yb * (X1 - X0)) */
+    uECC_vli_modInv(z, z, CURVE(curve)->p, num_words);            /* 1 / (xP * Yb * (X1 - X0)) */
     /* yP / (xP * Yb * (X1 - X0)) */
     uECC_vli_modMult_fast(z, z, point + num_words, curve);
     uECC_vli_modMult_fast(z, z, Rx[1 - nb], curve); /* Xb * yP / (xP * Yb * (X1 - X0)) */
@@ -912,12 +950,16 @@ static void EccPoint_mult(uECC_word_t * result, const uECC_word_t * point, const
     uECC_vli_set(result + num_words, Ry[0], num_words);
 }
 
+#if uECC_SUPPORTS_secp256r1 && uECC_SECP256R1_COMB
+#include "comb-secp256r1.inc"
+#endif
+
 static uECC_word_t regularize_k(const uECC_word_t * const k, uECC_word_t * k0, uECC_word_t * k1, uECC_Curve curve)
 {
-    wordcount_t num_n_words = BITS_TO_WORDS(curve->num_n_bits);
-    bitcount_t num_n_bits   = curve->num_n_bits;
-    uECC_word_t carry       = uECC_vli_add(k0, k, curve->n, num_n_words) || (num_n_bits < ((bitcount_t) num_n_words * uECC_WORD_SIZE * 8) && uECC_vli_testBit(k0, num_n_bits));
-    uECC_vli_add(k1, k0, curve->n, num_n_words);
+    wordcount_t num_n_words = BITS_TO_WORDS(CURVE(curve)->num_n_bits);
+    bitcount_t num_n_bits   = CURVE(curve)->num_n_bits;
+    uECC_word_t carry       = uECC_vli_add(k0, k, CURVE(curve)->n, num_n_words) || (num_n_bits < ((bitcount_t) num_n_words * uECC_WORD_SIZE * 8) && uECC_vli_testBit(k0, num_n_bits));
+    uECC_vli_add(k1, k0, CURVE(curve)->n, num_n_words);
     return carry;
 }
 
@@ -928,11 +970,18 @@ static uECC_word_t EccPoint_compute_public_key(uECC_word_t * result, uECC_word_t
     uECC_word_t * p2[2] = { tmp1, tmp2 };
     uECC_word_t carry;
 
+#if uECC_SUPPORTS_secp256r1 && uECC_SECP256R1_COMB
+    if (CURVE(curve) == &curve_secp256r1 && EccPoint_mult_comb_secp256r1(result, private_key, curve))
+    {
+        return 1;
+    }
+#endif
+
     /* Regularize the bitcount for the private key so that attackers cannot use a side channel
        attack to learn the number of leading zeros. */
     carry = regularize_k(private_key, tmp1, tmp2, curve);
 
-    EccPoint_mult(result, curve->G, p2[!carry], 0, curve->num_n_bits + 1, curve);
+    EccPoint_mult(result, CURVE(curve)->G, p2[!carry], 0, CURVE(curve)->num_n_bits + 1, curve);
 
     if (EccPoint_isZero(result, curve))
     {
@@ -1023,7 +1072,7 @@ int uECC_make_key(uint8_t * public_key, uint8_t * private_key, uECC_Curve curve)
 
     for (tries = 0; tries < uECC_RNG_MAX_TRIES; ++tries)
     {
-        if (!uECC_generate_random_int(_private, curve->n, BITS_TO_WORDS(curve->num_n_bits)))
+        if (!uECC_generate_random_int(_private, CURVE(curve)->n, BITS_TO_WORDS(CURVE(curve)->num_n_bits)))
         {
             return 0;
         }
@@ -1031,9 +1080,9 @@ int uECC_make_key(uint8_t * public_key, uint8_t * private_key, uECC_Curve curve)
         if (EccPoint_compute_public_key(_public, _private, curve))
         {
 #if uECC_VLI_NATIVE_LITTLE_ENDIAN == 0
-            uECC_vli_nativeToBytes(private_key, BITS_TO_BYTES(curve->num_n_bits), _private);
-            uECC_vli_nativeToBytes(public_key, curve->num_bytes, _public);
-            uECC_vli_nativeToBytes(public_key + curve->num_bytes, curve->num_bytes, _public + curve->num_words);
+            uECC_vli_nativeToBytes(private_key, BITS_TO_BYTES(CURVE(curve)->num_n_bits), _private);
+            uECC_vli_nativeToBytes(public_key, CURVE(curve)->num_bytes, _public);
+            uECC_vli_nativeToBytes(public_key + CURVE(curve)->num_bytes, CURVE(curve)->num_bytes, _public + CURVE(curve)->num_words);
 #endif
             return 1;
         }
@@ -1050,16 +1099,16 @@ int uECC_make_key_lit(uint8_t * public_key, uint8_t * private_key, uECC_Curve cu
 
     for (tries = 0; tries < uECC_RNG_MAX_TRIES; ++tries)
     {
-        if (!uECC_generate_random_int(_private, curve->n, BITS_TO_WORDS(curve->num_n_bits)))
+        if (!uECC_generate_random_int(_private, CURVE(curve)->n, BITS_TO_WORDS(CURVE(curve)->num_n_bits)))
         {
             return 0;
         }
 
         if (EccPoint_compute_public_key(_public, _private, curve))
         {
-            uECC_vli_nativeToBytes(private_key, BITS_TO_BYTES(curve->num_n_bits), _private);
-            uECC_vli_nativeToBytes(public_key, curve->num_bytes, _public);
-            uECC_vli_nativeToBytes(public_key + curve->num_bytes, curve->num_bytes, _public + curve->num_words);
+            uECC_vli_nativeToBytes(private_key, BITS_TO_BYTES(CURVE(curve)->num_n_bits), _private);
+            uECC_vli_nativeToBytes(public_key, CURVE(curve)->num_bytes, _public);
+            uECC_vli_nativeToBytes(public_key + CURVE(curve)->num_bytes, CURVE(curve)->num_bytes, _public + CURVE(curve)->num_words);
             return 1;
         }
     }
@@ -1075,10 +1124,10 @@ int uECC_shared_secret_lit(const uint8_t * public_key, const uint8_t * private_k
     uECC_word_t * p2[2]     = { _private, tmp };
     uECC_word_t * initial_Z = 0;
     uECC_word_t carry;
-    wordcount_t num_words = curve->num_words;
-    wordcount_t num_bytes = curve->num_bytes;
+    wordcount_t num_words = CURVE(curve)->num_words;
+    wordcount_t num_bytes = CURVE(curve)->num_bytes;
 
-    uECC_vli_bytesToNative(_private, private_key, BITS_TO_BYTES(curve->num_n_bits));
+    uECC_vli_bytesToNative(_private, private_key, BITS_TO_BYTES(CURVE(curve)->num_n_bits));
     uECC_vli_bytesToNative(_public, public_key, num_bytes);
     uECC_vli_bytesToNative(_public + num_words, public_key + num_bytes, num_bytes);
 
@@ -1090,14 +1139,14 @@ int uECC_shared_secret_lit(const uint8_t * public_key, const uint8_t * private_k
        protection against side-channel attacks. */
     if (g_rng_function)
     {
-        if (!uECC_generate_random_int(p2[carry], curve->p, num_words))
+        if (!uECC_generate_random_int(p2[carry], CURVE(curve)->p, num_words))
         {
             return 0;
         }
         initial_Z = p2[carry];
     }
 
-    EccPoint_mult(_public, _public, p2[!carry], initial_Z, curve->num_n_bits + 1, curve);
+    EccPoint_mult(_public, _public, p2[!carry], initial_Z, CURVE(curve)->num_n_bits + 1, curve);
 
     uECC_vli_nativeToBytes(secret, num_bytes, _public);
     return !EccPoint_isZero(_public, curve);
@@ -1112,14 +1161,14 @@ int uECC_shared_secret(const uint8_t * public_key, const uint8_t * private_key,
     uECC_word_t * p2[2]     = { _private, tmp };
     uECC_word_t * initial_Z = 0;
     uECC_word_t carry;
-    wordcount_t num_words = curve->num_words;
-    wordcount_t num_bytes = curve->num_bytes;
+    wordcount_t num_words = CURVE(curve)->num_words;
+    wordcount_t num_bytes = CURVE(curve)->num_bytes;
 
 #if uECC_VLI_NATIVE_LITTLE_ENDIAN
     __bocpy((uint8_t *) _private, private_key, num_bytes);
     __bocpy((uint8_t *) _public, public_key, num_bytes * 2);
 #else
-    uECC_vli_bytesToNative(_private, private_key, BITS_TO_BYTES(curve->num_n_bits));
+    uECC_vli_bytesToNative(_private, private_key, BITS_TO_BYTES(CURVE(curve)->num_n_bits));
     uECC_vli_bytesToNative(_public, public_key, num_bytes);
     uECC_vli_bytesToNative(_public + num_words, public_key + num_bytes, num_bytes);
 #endif
@@ -1132,14 +1181,14 @@ int uECC_shared_secret(const uint8_t * public_key, const uint8_t * private_key,
        protection against side-channel attacks. */
     if (g_rng_function)
     {
-        if (!uECC_generate_random_int(p2[carry], curve->p, num_words))
+        if (!uECC_generate_random_int(p2[carry], CURVE(curve)->p, num_words))
         {
             return 0;
         }
         initial_Z = p2[carry];
     }
 
-    EccPoint_mult(_public, _public, p2[!carry], initial_Z, curve->num_n_bits + 1, curve);
+    EccPoint_mult(_public, _public, p2[!carry], initial_Z, CURVE(curve)->num_n_bits + 1, curve);
 #if uECC_VLI_NATIVE_LITTLE_ENDIAN
     __bocpy((uint8_t *) secret, (uint8_t *) _public, num_bytes);
 #else
@@ -1152,14 +1201,14 @@ int uECC_shared_secret(const uint8_t * public_key, const uint8_t * private_key,
 void uECC_compress(const uint8_t * public_key, uint8_t * compressed, uECC_Curve curve)
 {
     wordcount_t i;
-    for (i = 0; i < curve->num_bytes; ++i)
+    for (i = 0; i < CURVE(curve)->num_bytes; ++i)
     {
         compressed[i + 1] = public_key[i];
     }
 #if uECC_VLI_NATIVE_LITTLE_ENDIAN
-    compressed[0] = 2 + (public_key[curve->num_bytes] & 0x01);
+    compressed[0] = 2 + (public_key[CURVE(curve)->num_bytes] & 0x01);
 #else
-    compressed[0] = 2 + (public_key[curve->num_bytes * 2 - 1] & 0x01);
+    compressed[0] = 2 + (public_key[CURVE(curve)->num_bytes * 2 - 1] & 0x01);
 #endif
 }
 
@@ -1170,23 +1219,23 @@ void uECC_decompress(const uint8_t * compressed, uint8_t * public_key, uECC_Curv
 #else
     uECC_word_t point[uECC_MAX_WORDS * 2];
 #endif
-    uECC_word_t * y = point + curve->num_words;
+    uECC_word_t * y = point + CURVE(curve)->num_words;
 #if uECC_VLI_NATIVE_LITTLE_ENDIAN
-    __bocpy(public_key, compressed + 1, curve->num_bytes);
+    __bocpy(public_key, compressed + 1, CURVE(curve)->num_bytes);
 #else
-    uECC_vli_bytesToNative(point, compressed + 1, curve->num_bytes);
+    uECC_vli_bytesToNative(point, compressed + 1, CURVE(curve)->num_bytes);
 #endif
-    curve->x_side(y, point, curve);
-    curve->mod_sqrt(y, curve);
+    CURVE(curve)->x_side(y, point, curve);
+    CURVE(curve)->mod_sqrt(y, curve);
 
     if ((y[0] & 0x01) != (compressed[0] & 0x01))
     {
-        uECC_vli_sub(y, curve->p, y, curve->num_words);
+        uECC_vli_sub(y, CURVE(curve)->p, y, CURVE(curve)->num_words);
     }
 
 #if uECC_VLI_NATIVE_LITTLE_ENDIAN == 0
-    uECC_vli_nativeToBytes(public_key, curve->num_bytes, point);
-    uECC_vli_nativeToBytes(public_key + curve->num_bytes, curve->num_bytes, y);
+    uECC_vli_nativeToBytes(public_key, CURVE(curve)->num_bytes, point);
+    uECC_vli_nativeToBytes(public_key + CURVE(curve)->num_bytes, CURVE(curve)->num_bytes, y);
 #endif
 }
 #endif /* uECC_SUPPORT_COMPRESSED_POINT */
@@ -1195,7 +1244,7 @@ int uECC_valid_point(const uECC_word_t * point, uECC_Curve curve)
 {
     uECC_word_t tmp1[uECC_MAX_WORDS];
     uECC_word_t tmp2[uECC_MAX_WORDS];
-    wordcount_t num_words = curve->num_words;
+    wordcount_t num_words = CURVE(curve)->num_words;
 
     /* The point at infinity is invalid. */
     if (EccPoint_isZero(point, curve))
@@ -1204,13 +1253,13 @@ int uECC_valid_point(const uECC_word_t * point, uECC_Curve curve)
     }
 
     /* x and y must be smaller than p. */
-    if (uECC_vli_cmp_unsafe(curve->p, point, num_words) != 1 || uECC_vli_cmp_unsafe(curve->p, point + num_words, num_words) != 1)
+    if (uECC_vli_cmp_unsafe(CURVE(curve)->p, point, num_words) != 1 || uECC_vli_cmp_unsafe(CURVE(curve)->p, point + num_words, num_words) != 1)
     {
         return 0;
     }
 
     uECC_vli_modSquare_fast(tmp1, point + num_words, curve);
-    curve->x_side(tmp2, point, curve); /* tmp2 = x^3 + ax + b */
+    CURVE(curve)->x_side(tmp2, point, curve); /* tmp2 = x^3 + ax + b */
 
     /* Make sure that y^2 == x^3 + ax + b */
     return (int) (uECC_vli_equal(tmp1, tmp2, num_words));
@@ -1225,8 +1274,8 @@ int uECC_valid_public_key(const uint8_t * public_key, uECC_Curve curve)
 #endif
 
 #if uECC_VLI_NATIVE_LITTLE_ENDIAN == 0
-    uECC_vli_bytesToNative(_public, public_key, curve->num_bytes);
-    uECC_vli_bytesToNative(_public + curve->num_words, public_key + curve->num_bytes, curve->num_bytes);
+    uECC_vli_bytesToNative(_public, public_key, CURVE(curve)->num_bytes);
+    uECC_vli_bytesToNative(_public + CURVE(curve)->num_words, public_key + CURVE(curve)->num_bytes, CURVE(curve)->num_bytes);
 #endif
     return uECC_valid_point(_public, curve);
 }
@@ -1242,16 +1291,16 @@ int uECC_compute_public_key(const uint8_t * private_key, uint8_t * public_key, u
 #endif
 
 #if uECC_VLI_NATIVE_LITTLE_ENDIAN == 0
-    uECC_vli_bytesToNative(_private, private_key, BITS_TO_BYTES(curve->num_n_bits));
+    uECC_vli_bytesToNative(_private, private_key, BITS_TO_BYTES(CURVE(curve)->num_n_bits));
 #endif
 
     /* Make sure the private key is in the range [1, n-1]. */
-    if (uECC_vli_isZero(_private, BITS_TO_WORDS(curve->num_n_bits)))
+    if (uECC_vli_isZero(_private, BITS_TO_WORDS(CURVE(curve)->num_n_bits)))
     {
         return 0;
     }
 
-    if (uECC_vli_cmp(curve->n, _private, BITS_TO_WORDS(curve->num_n_bits)) != 1)
+    if (uECC_vli_cmp(CURVE(curve)->n, _private, BITS_TO_WORDS(CURVE(curve)->num_n_bits)) != 1)
     {
         return 0;
     }
@@ -1263,8 +1312,8 @@ int uECC_compute_public_key(const uint8_t * private_key, uint8_t * public_key, u
     }
 
 #if uECC_VLI_NATIVE_LITTLE_ENDIAN == 0
-    uECC_vli_nativeToBytes(public_key, curve->num_bytes, _public);
-    uECC_vli_nativeToBytes(public_key + curve->num_bytes, curve->num_bytes, _public + curve->num_words);
+    uECC_vli_nativeToBytes(public_key, CURVE(curve)->num_bytes, _public);
+    uECC_vli_nativeToBytes(public_key + CURVE(curve)->num_bytes, CURVE(curve)->num_bytes, _public + CURVE(curve)->num_words);
 #endif
     return 1;
 }
@@ -1273,8 +1322,8 @@ int uECC_compute_public_key(const uint8_t * private_key, uint8_t * public_key, u
 
 static void bits2int(uECC_word_t * native, const uint8_t * bits, unsigned bits_size, uECC_Curve curve)
 {
-    unsigned num_n_bytes = BITS_TO_BYTES(curve->num_n_bits);
-    unsigned num_n_words = BITS_TO_WORDS(curve->num_n_bits);
+    unsigned num_n_bytes = BITS_TO_BYTES(CURVE(curve)->num_n_bits);
+    unsigned num_n_words = BITS_TO_WORDS(CURVE(curve)->num_n_bits);
     int shift;
     uECC_word_t carry;
     uECC_word_t * ptr;
@@ -1290,11 +1339,11 @@ static void bits2int(uECC_word_t * native, const uint8_t * bits, unsigned bits_s
 #else
     uECC_vli_bytesToNative(native, bits, bits_size);
 #endif
-    if (bits_size * 8 <= (unsigned) curve->num_n_bits)
+    if (bits_size * 8 <= (unsigned) CURVE(curve)->num_n_bits)
     {
         return;
     }
-    shift = bits_size * 8 - curve->num_n_bits;
+    shift = bits_size * 8 - CURVE(curve)->num_n_bits;
     carry = 0;
     ptr   = native + num_n_words;
     while (ptr-- > native)
@@ -1305,9 +1354,9 @@ static void bits2int(uECC_word_t * native, const uint8_t * bits, unsigned bits_s
     }
 
     /* Reduce mod curve_n */
-    if (uECC_vli_cmp_unsafe(curve->n, native, num_n_words) != 1)
+    if (uECC_vli_cmp_unsafe(CURVE(curve)->n, native, num_n_words) != 1)
     {
-        uECC_vli_sub(native, native, curve->n, num_n_words);
+        uECC_vli_sub(native, native, CURVE(curve)->n, num_n_words);
     }
 }
 
@@ -1323,18 +1372,18 @@ static int uECC_sign_with_k(const uint8_t * private_key, const uint8_t * message
     uECC_word_t p[uECC_MAX_WORDS * 2];
 #endif
     uECC_word_t carry;
-    wordcount_t num_words   = curve->num_words;
-    wordcount_t num_n_words = BITS_TO_WORDS(curve->num_n_bits);
-    bitcount_t num_n_bits   = curve->num_n_bits;
+    wordcount_t num_words   = CURVE(curve)->num_words;
+    wordcount_t num_n_words = BITS_TO_WORDS(CURVE(curve)->num_n_bits);
+    bitcount_t num_n_bits   = CURVE(curve)->num_n_bits;
 
     /* Make sure 0 < k < curve_n */
-    if (uECC_vli_isZero(k, num_words) || uECC_vli_cmp(curve->n, k, num_n_words) != 1)
+    if (uECC_vli_isZero(k, num_words) || uECC_vli_cmp(CURVE(curve)->n, k, num_n_words) != 1)
     {
         return 0;
     }
 
     carry = regularize_k(k, tmp, s, curve);
-    EccPoint_mult(p, curve->G, k2[!carry], 0, num_n_bits + 1, curve);
+    EccPoint_mult(p, CURVE(curve)->G, k2[!carry], 0, num_n_bits + 1, curve);
     if (uECC_vli_isZero(p, num_words))
     {
         return 0;
@@ -1347,42 +1396,42 @@ static int uECC_sign_with_k(const uint8_t * private_key, const uint8_t * message
         uECC_vli_clear(tmp, num_n_words);
         tmp[0] = 1;
     }
-    else if (!uECC_generate_random_int(tmp, curve->n, num_n_words))
+    else if (!uECC_generate_random_int(tmp, CURVE(curve)->n, num_n_words))
     {
         return 0;
     }
 
     /* Prevent side channel analysis of uECC_vli_modInv() to determine
        bits of k / the private key by premultiplying by a random number */
-    uECC_vli_modMult(k, k, tmp, curve->n, num_n_words); /* k' = rand * k */
-    uECC_vli_modInv(k, k, curve->n, num_n_words);       /* k = 1 / k' */
-    uECC_vli_modMult(k, k, tmp, curve->n, num_n_words); /* k = 1 / k */
+    uECC_vli_modMult(k, k, tmp, CURVE(curve)->n, num_n_words); /* k' = rand * k */
+    uECC_vli_modInv(k, k, CURVE(curve)->n, num_n_words);       /* k = 1 / k' */
+    uECC_vli_modMult(k, k, tmp, CURVE(curve)->n, num_n_words); /* k = 1 / k */
 
 #if uECC_VLI_NATIVE_LITTLE_ENDIAN == 0
-    uECC_vli_nativeToBytes(signature, curve->num_bytes, p); /* store r */
+    uECC_vli_nativeToBytes(signature, CURVE(curve)->num_bytes, p); /* store r */
 #endif
 
 #if uECC_VLI_NATIVE_LITTLE_ENDIAN
-    __bocpy((uint8_t *) tmp, private_key, BITS_TO_BYTES(curve->num_n_bits));
+    __bocpy((uint8_t *) tmp, private_key, BITS_TO_BYTES(CURVE(curve)->num_n_bits));
 #else
-    uECC_vli_bytesToNative(tmp, private_key, BITS_TO_BYTES(curve->num_n_bits)); /* tmp = d */
+    uECC_vli_bytesToNative(tmp, private_key, BITS_TO_BYTES(CURVE(curve)->num_n_bits)); /* tmp = d */
 #endif
 
     s[num_n_words - 1] = 0;
     uECC_vli_set(s, p, num_words);
-    uECC_vli_modMult(s, tmp, s, curve->n, num_n_words); /* s = r*d */
+    uECC_vli_modMult(s, tmp, s, CURVE(curve)->n, num_n_words); /* s = r*d */
 
     bits2int(tmp, message_hash, hash_size, curve);
-    uECC_vli_modAdd(s, tmp, s, curve->n, num_n_words); /* s = e + r*d */
-    uECC_vli_modMult(s, s, k, curve->n, num_n_words);  /* s = (e + r*d) / k */
-    if (uECC_vli_numBits(s, num_n_words) > (bitcount_t) curve->num_bytes * 8)
+    uECC_vli_modAdd(s, tmp, s, CURVE(curve)->n, num_n_words); /* s = e + r*d */
+    uECC_vli_modMult(s, s, k, CURVE(curve)->n, num_n_words);  /* s = (e + r*d) / k */
+    if (uECC_vli_numBits(s, num_n_words) > (bitcount_t) CURVE(curve)->num_bytes * 8)
     {
         return 0;
     }
 #if uECC_VLI_NATIVE_LITTLE_ENDIAN
-    __bocpy((uint8_t *) signature + curve->num_bytes, (uint8_t *) s, curve->num_bytes);
+    __bocpy((uint8_t *) signature + CURVE(curve)->num_bytes, (uint8_t *) s, CURVE(curve)->num_bytes);
 #else
-    uECC_vli_nativeToBytes(signature + curve->num_bytes, curve->num_bytes, s);
+    uECC_vli_nativeToBytes(signature + CURVE(curve)->num_bytes, CURVE(curve)->num_bytes, s);
 #endif
     return 1;
 }
@@ -1394,7 +1443,7 @@ int uECC_sign(const uint8_t * private_key, const uint8_t * message_hash, unsigne
 
     for (tries = 0; tries < uECC_RNG_MAX_TRIES; ++tries)
     {
-        if (!uECC_generate_random_int(k, curve->n, BITS_TO_WORDS(curve->num_n_bits)))
+        if (!uECC_generate_random_int(k, CURVE(curve)->n, BITS_TO_WORDS(CURVE(curve)->num_n_bits)))
         {
             return 0;
         }
@@ -1462,9 +1511,9 @@ int uECC_sign_deterministic(const uint8_t * private_key, const uint8_t * message
 {
     uint8_t * K             = hash_context->tmp;
     uint8_t * V             = K + hash_context->result_size;
-    wordcount_t num_bytes   = curve->num_bytes;
-    wordcount_t num_n_words = BITS_TO_WORDS(curve->num_n_bits);
-    bitcount_t num_n_bits   = curve->num_n_bits;
+    wordcount_t num_bytes   = CURVE(curve)->num_bytes;
+    wordcount_t num_n_words = BITS_TO_WORDS(CURVE(curve)->num_n_bits);
+    bitcount_t num_n_bits   = CURVE(curve)->num_n_bits;
     uECC_word_t tries;
     unsigned i;
     for (i = 0; i < hash_context->result_size; ++i)
@@ -1558,21 +1607,21 @@ int uECC_verify(const uint8_t * public_key, const uint8_t * message_hash, unsign
     uECC_word_t _public[uECC_MAX_WORDS * 2];
 #endif
     uECC_word_t r[uECC_MAX_WORDS], s[uECC_MAX_WORDS];
-    wordcount_t num_words   = curve->num_words;
-    wordcount_t num_n_words = BITS_TO_WORDS(curve->num_n_bits);
+    wordcount_t num_words   = CURVE(curve)->num_words;
+    wordcount_t num_n_words = BITS_TO_WORDS(CURVE(curve)->num_n_bits);
 
     rx[num_n_words - 1] = 0;
     r[num_n_words - 1]  = 0;
     s[num_n_words - 1]  = 0;
 
 #if uECC_VLI_NATIVE_LITTLE_ENDIAN
-    __bocpy((uint8_t *) r, signature, curve->num_bytes);
-    __bocpy((uint8_t *) s, signature + curve->num_bytes, curve->num_bytes);
+    __bocpy((uint8_t *) r, signature, CURVE(curve)->num_bytes);
+    __bocpy((uint8_t *) s, signature + CURVE(curve)->num_bytes, CURVE(curve)->num_bytes);
 #else
-    uECC_vli_bytesToNative(_public, public_key, curve->num_bytes);
-    uECC_vli_bytesToNative(_public + num_words, public_key + curve->num_bytes, curve->num_bytes);
-    uECC_vli_bytesToNative(r, signature, curve->num_bytes);
-    uECC_vli_bytesToNative(s, signature + curve->num_bytes, curve->num_bytes);
+    uECC_vli_bytesToNative(_public, public_key, CURVE(curve)->num_bytes);
+    uECC_vli_bytesToNative(_public + num_words, public_key + CURVE(curve)->num_bytes, CURVE(curve)->num_bytes);
+    uECC_vli_bytesToNative(r, signature, CURVE(curve)->num_bytes);
+    uECC_vli_bytesToNative(s, signature + CURVE(curve)->num_bytes, CURVE(curve)->num_bytes);
 #endif
 
     /* r, s must not be 0. */
@@ -1582,31 +1631,31 @@ int uECC_verify(const uint8_t * public_key, const uint8_t * message_hash, unsign
     }
 
     /* r, s must be < n. */
-    if (uECC_vli_cmp_unsafe(curve->n, r, num_n_words) != 1 || uECC_vli_cmp_unsafe(curve->n, s, num_n_words) != 1)
+    if (uECC_vli_cmp_unsafe(CURVE(curve)->n, r, num_n_words) != 1 || uECC_vli_cmp_unsafe(CURVE(curve)->n, s, num_n_words) != 1)
     {
         return 0;
     }
 
     /* Calculate u1 and u2. */
-    uECC_vli_modInv(z, s, curve->n, num_n_words); /* z = 1/s */
+    uECC_vli_modInv(z, s, CURVE(curve)->n, num_n_words); /* z = 1/s */
     u1[num_n_words - 1] = 0;
     bits2int(u1, message_hash, hash_size, curve);
-    uECC_vli_modMult(u1, u1, z, curve->n, num_n_words); /* u1 = e/s */
-    uECC_vli_modMult(u2, r, z, curve->n, num_n_words);  /* u2 = r/s */
+    uECC_vli_modMult(u1, u1, z, CURVE(curve)->n, num_n_words); /* u1 = e/s */
+    uECC_vli_modMult(u2, r, z, CURVE(curve)->n, num_n_words);  /* u2 = r/s */
 
     /* Calculate sum = G + Q. */
     uECC_vli_set(sum, _public, num_words);
     uECC_vli_set(sum + num_words, _public + num_words, num_words);
-    uECC_vli_set(tx, curve->G, num_words);
-    uECC_vli_set(ty, curve->G + num_words, num_words);
-    uECC_vli_modSub(z, sum, tx, curve->p, num_words); /* z = x2 - x1 */
+    uECC_vli_set(tx, CURVE(curve)->G, num_words);
+    uECC_vli_set(ty, CURVE(curve)->G + num_words, num_words);
+    uECC_vli_modSub(z, sum, tx, CURVE(curve)->p, num_words); /* z = x2 - x1 */
     XYcZ_add(tx, ty, sum, sum + num_words, curve);
-    uECC_vli_modInv(z, z, curve->p, num_words); /* z = 1/z */
+    uECC_vli_modInv(z, z, CURVE(curve)->p, num_words); /* z = 1/z */
     apply_z(sum, sum + num_words, z, curve);
 
     /* Use Shamir's trick to calculate u1*G + u2*Q */
     points[0] = 0;
-    points[1] = curve->G;
+    points[1] = CURVE(curve)->G;
     points[2] = _public;
     points[3] = sum;
     num_bits  = smax(uECC_vli_numBits(u1, num_n_words), uECC_vli_numBits(u2, num_n_words));
@@ -1620,7 +1669,7 @@ int uECC_verify(const uint8_t * public_key, const uint8_t * message_hash, unsign
     for (i = num_bits - 2; i >= 0; --i)
     {
         uECC_word_t index;
-        curve->double_jacobian(rx, ry, z, curve);
+        CURVE(curve)->double_jacobian(rx, ry, z, curve);
 
         index = (!!uECC_vli_testBit(u1, i)) | ((!!uECC_vli_testBit(u2, i)) << 1);
         point = points[index];
@@ -1629,19 +1678,19 @@ int uECC_verify(const uint8_t * public_key, const uint8_t * message_hash, unsign
             uECC_vli_set(tx, point, num_words);
             uECC_vli_set(ty, point + num_words, num_words);
             apply_z(tx, ty, z, curve);
-            uECC_vli_modSub(tz, rx, tx, curve->p, num_words); /* Z = x2 - x1 */
+            uECC_vli_modSub(tz, rx, tx, CURVE(curve)->p, num_words); /* Z = x2 - x1 */
             XYcZ_add(tx, ty, rx, ry, curve);
             uECC_vli_modMult_fast(z, z, tz, curve);
         }
     }
 
-    uECC_vli_modInv(z, z, curve->p, num_words); /* Z = 1/Z */
+    uECC_vli_modInv(z, z, CURVE(curve)->p, num_words); /* Z = 1/Z */
     apply_z(rx, ry, z, curve);
 
     /* v = x1 (mod n) */
-    if (uECC_vli_cmp_unsafe(curve->n, rx, num_n_words) != 1)
+    if (uECC_vli_cmp_unsafe(CURVE(curve)->n, rx, num_n_words) != 1)
     {
-        uECC_vli_sub(rx, rx, curve->n, num_n_words);
+        uECC_vli_sub(rx, rx, CURVE(curve)->n, num_n_words);
     }
 
     /* Accept only if v == r. */
@@ -1652,67 +1701,67 @@ int uECC_verify(const uint8_t * public_key, const uint8_t * message_hash, unsign
 
 unsigned uECC_curve_num_words(uECC_Curve curve)
 {
-    return curve->num_words;
+    return CURVE(curve)->num_words;
 }
 
 unsigned uECC_curve_num_bytes(uECC_Curve curve)
 {
-    return curve->num_bytes;
+    return CURVE(curve)->num_bytes;
 }
 
 unsigned uECC_curve_num_bits(uECC_Curve curve)
 {
-    return curve->num_bytes * 8;
+    return CURVE(curve)->num_bytes * 8;
 }
 
 unsigned uECC_curve_num_n_words(uECC_Curve curve)
 {
-    return BITS_TO_WORDS(curve->num_n_bits);
+    return BITS_TO_WORDS(CURVE(curve)->num_n_bits);
 }
 
 unsigned uECC_curve_num_n_bytes(uECC_Curve curve)
 {
-    return BITS_TO_BYTES(curve->num_n_bits);
+    return BITS_TO_BYTES(CURVE(curve)->num_n_bits);
 }
 
 unsigned uECC_curve_num_n_bits(uECC_Curve curve)
 {
-    return curve->num_n_bits;
+    return CURVE(curve)->num_n_bits;
 }
 
 const uECC_word_t * uECC_curve_p(uECC_Curve curve)
 {
-    return curve->p;
+    return CURVE(curve)->p;
 }
 
 const uECC_word_t * uECC_curve_n(uECC_Curve curve)
 {
-    return curve->n;
+    return CURVE(curve)->n;
 }
 
 const uECC_word_t * uECC_curve_G(uECC_Curve curve)
 {
-    return curve->G;
+    return CURVE(curve)->G;
 }
 
 const uECC_word_t * uECC_curve_b(uECC_Curve curve)
 {
-    return curve->b;
+    return CURVE(curve)->b;
 }
 
 #if uECC_SUPPORT_COMPRESSED_POINT
 void uECC_vli_mod_sqrt(uECC_word_t * a, uECC_Curve curve)
 {
-    curve->mod_sqrt(a, curve);
+    CURVE(curve)->mod_sqrt(a, curve);
 }
 #endif
 
 void uECC_vli_mmod_fast(uECC_word_t * result, uECC_word_t * product, uECC_Curve curve)
 {
 #if (uECC_OPTIMIZATION_LEVEL > 0)
-    curve->mmod_fast(result, product);
+    CURVE(curve)->mmod_fast(result, product);
 #else
-    uECC_vli_mmod(result, product, curve->p, curve->num_words);
+    uECC_vli_mmod(result, product, CURVE(curve)->p, CURVE(curve)->num_words);
 #endif
 }
 
@@ -1723,7 +1772,7 @@ void uECC_point_mult(uECC_word_t * result, const uECC_word_t * point, const uECC
     uECC_word_t * p2[2] = { tmp1, tmp2 };
     uECC_word_t carry   = regularize_k(scalar, tmp1, tmp2, curve);
 
-    EccPoint_mult(result, point, p2[!carry], 0, curve->num_n_bits + 1, curve);
+    EccPoint_mult(result, point, p2[!carry], 0, CURVE(curve)->num_n_bits + 1, curve);
 }
 
 #endif /* uECC_ENABLE_VLI_API */
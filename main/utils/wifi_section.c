@@ -18,6 +18,9 @@
 
 #include "lwip/err.h"
 #include "lwip/sys.h"
+#include "ssm_boot.h"
+#include "ssm_sup.h"
+#include "ssm_timer.h"
 #include "wifi_section.h"
 
 /* The examples use WiFi configuration that you can set via project configuration menu
@@ -62,9 +65,15 @@ static EventGroupHandle_t s_wifi_event_group;
 static const char * TAG = "wifi station";
 
 static int s_retry_num = 0;
+static ssm_backoff_t s_backoff = {}; // retries after the quick ones
 
 int wifi_connected_to_ap = 0;
 
+static void wifi_retry(void * arg) {
+	ESP_LOGI(TAG, "retry to connect to the AP");
+	esp_wifi_connect();
+}
+
 static void wifi_event_handler(void * arg, esp_event_base_t event_base, int32_t event_id, void * event_data) {
 	if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
 		esp_wifi_connect();
@@ -73,21 +82,27 @@ static void wifi_event_handler(void * arg, esp_event_base_t event_base, int32_t
 			esp_wifi_connect();
 			s_retry_num++;
 			ESP_LOGI(TAG, "retry to connect to the AP");
-		} else {
+		} else { // keep trying in the background instead of restarting
 			xEventGroupSetBits(s_wifi_event_group, WIFI_FAIL_BIT);
-			ESP_LOGI(TAG, "connect to the AP fail");
-			esp_restart();
+			wifi_connected_to_ap = 0;
+			uint32_t delay_ms = ssm_backoff_next(&s_backoff, 2000);
+			ESP_LOGI(TAG, "connect to the AP fail, retry in %lu ms", (unsigned long) delay_ms);
+			ssm_timer_start(wifi_retry, NULL, delay_ms, 0);
 		}
 		ESP_LOGI(TAG, "connect to the AP fail");
 	} else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
 		ip_event_got_ip_t * event = (ip_event_got_ip_t *) event_data;
 		ESP_LOGI(TAG, "got ip:" IPSTR, IP2STR(&event->ip_info.ip));
 		s_retry_num = 0;
+		ssm_backoff_reset(&s_backoff);
+		wifi_connected_to_ap = 1;
+		ssm_boot_mark(SSM_BOOT_WIFI_IP);
 		xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
 	}
 }
 
 void wifi_init_sta(void) {
+	ssm_boot_mark(SSM_BOOT_WIFI_START);
 	wifi_connected_to_ap = 0;
 
 	s_wifi_event_group = xEventGroupCreate();
@@ -136,11 +151,9 @@ void wifi_init_sta(void) {
 	if (bits & WIFI_CONNECTED_BIT) {
 		wifi_connected_to_ap = 1;
 		ESP_LOGI(TAG, "connected to ap SSID:%s password:%s", config_wifi_ssid, config_wifi_password);
-	} else if (bits & WIFI_FAIL_BIT) {
-		ESP_LOGI(TAG, "Failed to connect to SSID:%s, password:%s", config_wifi_ssid, config_wifi_password);
-		esp_restart();
+	} else if (bits & WIFI_FAIL_BIT) { // wifi_connected_to_ap is set when a later retry succeeds
+		ESP_LOGI(TAG, "Failed to connect to SSID:%s, password:%s, keep retrying", config_wifi_ssid, config_wifi_password);
 	} else {
 		ESP_LOGE(TAG, "UNEXPECTED EVENT");
-		esp_restart();
 	}
 }
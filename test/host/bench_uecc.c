@@ -0,0 +1,61 @@
+/*
+ * Host benchmark of uECC secp256r1 key generation and ECDH, main/utils/uECC.c.
+ * The RNG is seeded with a constant, so every build prints the same hash of the shared secrets. Compare backends with
+ * -DCMAKE_C_FLAGS="-DuECC_PLATFORM=uECC_arch_other" or "-DuECC_SQUARE_FUNC=1".
+ */
+
+#include "uECC.h"
+#include "types.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static uint32_t seed = 1;
+
+static int bench_rng(uint8_t * dest, unsigned size) {
+	for (unsigned i = 0; i < size; i++) {
+		seed = seed * 1103515245u + 12345u;
+		dest[i] = (uint8_t) (seed >> 16);
+	}
+	return 1;
+}
+
+static double now_us(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1e6 + t.tv_nsec / 1e3;
+}
+
+int main(int argc, char ** argv) {
+	int runs = (argc > 1) ? atoi(argv[1]) : 200;
+	uECC_Curve curve = uECC_secp256r1();
+	uint8_t pub1[64], priv1[32], pub2[64], priv2[32], secret1[32], secret2[32];
+	uint32_t hash = 0;
+	int bad = 0;
+	double t_key = 0, t_ecdh = 0;
+
+	uECC_set_rng(bench_rng);
+	for (int i = 0; i < runs; i++) {
+		double t0 = now_us();
+		if (!uECC_make_key_lit(pub1, priv1, curve) || !uECC_make_key_lit(pub2, priv2, curve)) {
+			bad++;
+			continue;
+		}
+		double t1 = now_us();
+		if (!uECC_shared_secret_lit(pub2, priv1, secret1, curve) || !uECC_shared_secret_lit(pub1, priv2, secret2, curve)) {
+			bad++;
+			continue;
+		}
+		double t2 = now_us();
+		t_key += (t1 - t0) / 2;
+		t_ecdh += (t2 - t1) / 2;
+		bad += memcmp(secret1, secret2, sizeof(secret1)) != 0;
+		for (int j = 0; j < 32; j++) {
+			hash = hash * 31 + secret1[j];
+		}
+	}
+	printf("word %d square %d: keygen %.1f us, ecdh %.1f us, %d of %d failed, hash %08x\n", uECC_WORD_SIZE, uECC_SQUARE_FUNC,
+		   t_key / runs, t_ecdh / runs, bad, runs, (unsigned) hash);
+	return bad != 0;
+}
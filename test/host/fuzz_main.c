@@ -0,0 +1,73 @@
+/*
+ * Driver of a libFuzzer target for compilers without -fsanitize=fuzzer. Runs the target on the files given as
+ * arguments, or on N pseudo-random inputs built from JSON fragments and random bytes if the argument is a number.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int LLVMFuzzerTestOneInput(const uint8_t * data, size_t size);
+
+static const char * fragments[] = { "{", "}", "[", "]", "\"", ":", ",", " ", "\\", "\"action\"", "\"code\"", "\"mac\"", "\"lock\"", "\"position\"", "\"unlock\"", "-", "1", "160.5", "aa:bb:cc:dd:ee:ff", "null", "true" };
+
+static uint32_t rnd_state = 1;
+
+static uint32_t rnd(void) { // xorshift32, reproducible across runs
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 17;
+	rnd_state ^= rnd_state << 5;
+	return rnd_state;
+}
+
+static int run_file(const char * path) {
+	FILE * f = fopen(path, "rb");
+	if (f == NULL) {
+		perror(path);
+		return 1;
+	}
+	uint8_t buf[4096];
+	size_t size = fread(buf, 1, sizeof(buf), f);
+	fclose(f);
+	uint8_t * data = malloc(size ? size : 1); // exact size, so ASan sees a read past the end
+	memcpy(data, buf, size);
+	LLVMFuzzerTestOneInput(data, size);
+	free(data);
+	return 0;
+}
+
+int main(int argc, char ** argv) {
+	char * end;
+	long runs = (argc == 2) ? strtol(argv[1], &end, 10) : 0;
+	if (argc < 2 || *end != '\0') {
+		int rc = 0;
+		for (int n = 1; n < argc; n++) {
+			rc |= run_file(argv[n]);
+		}
+		return rc;
+	}
+	for (long n = 0; n < runs; n++) {
+		uint8_t buf[256];
+		size_t size = 0, target = rnd() % sizeof(buf);
+		while (size < target) {
+			if (rnd() % 4 == 0) {
+				buf[size++] = (uint8_t) rnd();
+			} else {
+				const char * frag = fragments[rnd() % (sizeof(fragments) / sizeof(fragments[0]))];
+				size_t len = strlen(frag);
+				if (size + len > sizeof(buf)) {
+					break;
+				}
+				memcpy(buf + size, frag, len);
+				size += len;
+			}
+		}
+		uint8_t * data = malloc(size ? size : 1);
+		memcpy(data, buf, size);
+		LLVMFuzzerTestOneInput(data, size);
+		free(data);
+	}
+	printf("%ld inputs\n", runs);
+	return 0;
+}
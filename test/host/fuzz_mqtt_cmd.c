@@ -0,0 +1,31 @@
+/*
+ * Fuzz target of mqtt_cmd_parse() over arbitrary payloads. The payload of an MQTT event is not NUL terminated, a
+ * read past data + size is reported by ASan. The fields of a parsed command must point into the payload.
+ */
+
+#include "mqtt_cmd.h"
+#include <stdlib.h>
+
+static void check_str(const mqtt_cmd_str_t * str, const uint8_t * data, size_t size) {
+	if (str->len == 0) {
+		return;
+	}
+	if (str->ptr < (const char *) data || str->ptr + str->len > (const char *) data + size) {
+		abort();
+	}
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t * data, size_t size) {
+	mqtt_cmd_t cmd;
+	uint8_t addr[6];
+	if (mqtt_cmd_parse((const char *) data, (int) size, &cmd)) {
+		if (cmd.action.len == 0) {
+			abort();
+		}
+		check_str(&cmd.action, data, size);
+		check_str(&cmd.code, data, size);
+		check_str(&cmd.mac, data, size);
+		mqtt_cmd_mac_to_addr(&cmd.mac, addr);
+	}
+	return 0;
+}
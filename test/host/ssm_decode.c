@@ -0,0 +1,108 @@
+/*
+ * Host-side decoder of the Sesame BLE protocol, built on the name tables of main/sesame/candy.c. Each argument, or
+ * each line of stdin without arguments, is one notification or write as hex, e.g. a capture from the nRF Connect log:
+ *   ssm_decode "03 08 0e 11 22 33 44"
+ * Segments are reassembled like ssm_ble_receiver() does. A plaintext message is printed as op code, item code and
+ * payload; a ciphertext one only with its length, since the session token is needed to decrypt it.
+ */
+
+#include "candy.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+#define SSM_DECODE_BUF 512
+
+static uint8_t b_buf[SSM_DECODE_BUF];
+static int c_offset = 0;
+
+static int hex_nibble(char c) {
+	if (c >= '0' && c <= '9') {
+		return c - '0';
+	}
+	c = (char) tolower((unsigned char) c);
+	if (c >= 'a' && c <= 'f') {
+		return c - 'a' + 10;
+	}
+	return -1;
+}
+
+// parse hex bytes, separators between bytes are skipped. Return the length, -1 if invalid
+static int parse_hex(const char * s, uint8_t * out, int size) {
+	int len = 0;
+	while (*s) {
+		int hi = hex_nibble(s[0]);
+		if (hi < 0) { // any other character separates bytes
+			s++;
+			continue;
+		}
+		int lo = hex_nibble(s[1]);
+		if (lo < 0 || len == size) {
+			return -1;
+		}
+		out[len++] = (uint8_t) ((hi << 4) | lo);
+		s += 2;
+	}
+	return len;
+}
+
+static void print_message(int parsing_type) {
+	if (parsing_type == SSM_SEG_PARSING_TYPE_CIPHERTEXT) {
+		printf("ciphertext %d bytes\n", c_offset - CCM_TAG_LENGTH);
+		return;
+	}
+	if (c_offset < 2) {
+		printf("short message %d bytes\n", c_offset);
+		return;
+	}
+	printf("%s %s", SSM_OP_CODE_STR(b_buf[0]), SSM_ITEM_CODE_STR(b_buf[1]));
+	if (c_offset > 2) {
+		printf(" ");
+		for (int n = 2; n < c_offset; n++) {
+			printf("%02x", b_buf[n]);
+		}
+	}
+	printf("\n");
+}
+
+static int decode_segment(const char * hex) {
+	uint8_t seg[256];
+	int len = parse_hex(hex, seg, sizeof(seg));
+	if (len < 2) {
+		fprintf(stderr, "invalid segment: %s\n", hex);
+		return 0;
+	}
+	if (seg[0] & 1u) { // first segment of a message
+		c_offset = 0;
+	}
+	if (c_offset + len - 1 > SSM_DECODE_BUF) {
+		fprintf(stderr, "message too long\n");
+		c_offset = 0;
+		return 0;
+	}
+	memcpy(&b_buf[c_offset], seg + 1, len - 1);
+	c_offset += len - 1;
+	if (seg[0] >> 1u != SSM_SEG_PARSING_TYPE_APPEND_ONLY) { // last segment
+		print_message(seg[0] >> 1u);
+		c_offset = 0;
+	}
+	return 1;
+}
+
+int main(int argc, char ** argv) {
+	int ok = 1;
+	if (argc > 1) {
+		for (int n = 1; n < argc; n++) {
+			ok &= decode_segment(argv[n]);
+		}
+		return !ok;
+	}
+	char line[1024];
+	while (fgets(line, sizeof(line), stdin) != NULL) {
+		line[strcspn(line, "\r\n")] = 0;
+		if (line[0] != 0 && line[0] != '#') {
+			ok &= decode_segment(line);
+		}
+	}
+	return !ok;
+}
@@ -0,0 +1,151 @@
+/*
+ * Host tests of the MQTT command parser and action lookup, main/utils/mqtt_cmd.c.
+ */
+
+#include "mqtt_cmd.h"
+#include <stdio.h>
+#include <string.h>
+
+static int failures = 0;
+
+#define CHECK(cond)                                                         \
+	do {                                                                    \
+		if (!(cond)) {                                                      \
+			printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+			failures++;                                                     \
+		}                                                                   \
+	} while (0)
+
+static int parse(const char * payload, mqtt_cmd_t * cmd) {
+	return mqtt_cmd_parse(payload, (int) strlen(payload), cmd);
+}
+
+static void test_object(void) {
+	mqtt_cmd_t cmd;
+	CHECK(parse("{\"action\": \"lock\", \"code\": \"1234\"}", &cmd));
+	CHECK(mqtt_cmd_str_eq(&cmd.action, "lock"));
+	CHECK(mqtt_cmd_str_eq(&cmd.code, "1234"));
+	CHECK(cmd.mac.len == 0);
+	CHECK(!cmd.has_position);
+}
+
+static void test_key_order_and_whitespace(void) {
+	mqtt_cmd_t cmd;
+	CHECK(parse(" {\n\t\"code\" :\"1\" ,\r\n \"action\":\"unlock\"\n} ", &cmd));
+	CHECK(mqtt_cmd_str_eq(&cmd.action, "unlock"));
+	CHECK(mqtt_cmd_str_eq(&cmd.code, "1"));
+	CHECK(parse("{\"action\": \"lock\", }", &cmd)); // a trailing comma is tolerated
+	CHECK(mqtt_cmd_str_eq(&cmd.action, "lock"));
+}
+
+static void test_unknown_and_nested_values(void) {
+	mqtt_cmd_t cmd;
+	CHECK(parse("{\"x\": {\"action\": \"bad\", \"y\": [1, \"}\"]}, \"n\": null, \"t\": true, \"action\": \"magnet\"}", &cmd));
+	CHECK(mqtt_cmd_str_eq(&cmd.action, "magnet"));
+}
+
+static void test_position(void) {
+	mqtt_cmd_t cmd;
+	CHECK(parse("{ \"action\": \"set_lock_position\", \"lock\": \"160\" }", &cmd));
+	CHECK(cmd.has_position && cmd.position == 160);
+	CHECK(parse("{\"action\": \"set_unlock_position\", \"unlock\": -20.7}", &cmd));
+	CHECK(cmd.has_position && cmd.position == -20);
+	CHECK(parse("{\"action\": \"set_lock_position\", \"position\": \" 99999999 \"}", &cmd));
+	CHECK(cmd.has_position && cmd.position == INT16_MAX);
+	CHECK(parse("{\"action\": \"set_lock_position\", \"lock\": \"abc\"}", &cmd));
+	CHECK(!cmd.has_position);
+	CHECK(parse("{\"action\": \"set_lock_position\", \"lock\": \"\"}", &cmd));
+	CHECK(!cmd.has_position);
+}
+
+static void test_mac(void) {
+	mqtt_cmd_t cmd;
+	uint8_t addr[6];
+	const uint8_t expected[6] = { 0xff, 0xee, 0xdd, 0xcc, 0xbb, 0xaa };
+	CHECK(parse("{\"action\": \"add_sesame\", \"mac\": \"AA:bb:cc:dd:ee:FF\"}", &cmd));
+	CHECK(mqtt_cmd_mac_to_addr(&cmd.mac, addr) && memcmp(addr, expected, 6) == 0);
+	CHECK(parse("{\"action\": \"remove_sesame\", \"addr\": \"aabbccddeeff\"}", &cmd));
+	CHECK(mqtt_cmd_mac_to_addr(&cmd.mac, addr) && memcmp(addr, expected, 6) == 0);
+	CHECK(parse("{\"action\": \"add_sesame\", \"mac\": \"aa:bb:cc:dd:ee:fg\"}", &cmd));
+	CHECK(!mqtt_cmd_mac_to_addr(&cmd.mac, addr));
+	CHECK(parse("{\"action\": \"add_sesame\", \"mac\": \"aa.bb:cc:dd:ee:ff\"}", &cmd));
+	CHECK(!mqtt_cmd_mac_to_addr(&cmd.mac, addr));
+	CHECK(parse("{\"action\": \"add_sesame\"}", &cmd));
+	CHECK(!mqtt_cmd_mac_to_addr(&cmd.mac, addr));
+}
+
+static void test_plain_payload(void) {
+	mqtt_cmd_t cmd;
+	CHECK(parse("lock", &cmd));
+	CHECK(mqtt_cmd_str_eq(&cmd.action, "lock"));
+	CHECK(parse("  unlock \r\n", &cmd));
+	CHECK(mqtt_cmd_str_eq(&cmd.action, "unlock"));
+	CHECK(parse("\"magnet\"", &cmd));
+	CHECK(mqtt_cmd_str_eq(&cmd.action, "magnet"));
+}
+
+static void test_not_terminated(void) {
+	const char payload[] = "{\"action\": \"lock\"}XXXX"; // an MQTT payload is not NUL terminated
+	mqtt_cmd_t cmd;
+	CHECK(mqtt_cmd_parse(payload, 18, &cmd));
+	CHECK(mqtt_cmd_str_eq(&cmd.action, "lock"));
+	CHECK(!mqtt_cmd_parse(payload, 17, &cmd)); // cut before the closing brace
+	CHECK(!mqtt_cmd_parse(payload, 10, &cmd)); // cut inside a key
+}
+
+static void test_invalid(void) {
+	mqtt_cmd_t cmd;
+	CHECK(!mqtt_cmd_parse(NULL, 4, &cmd));
+	CHECK(!mqtt_cmd_parse("lock", 0, &cmd));
+	CHECK(!parse("   ", &cmd));
+	CHECK(!parse("{}", &cmd));
+	CHECK(!parse("{\"code\": \"1\"}", &cmd)); // no action
+	CHECK(!parse("{\"action\" \"lock\"}", &cmd));
+	CHECK(!parse("{\"action\": \"lock\" \"code\": \"1\"}", &cmd));
+	CHECK(!parse("{\"action\": \"lock", &cmd));
+	CHECK(!parse("{\"action\": \"lock\\\"}", &cmd)); // escaped quote doesn't end the string
+	CHECK(!parse("{\"action\": {\"a\": 1}", &cmd));
+	CHECK(!parse("{action: \"lock\"}", &cmd));
+	CHECK(!parse("\"", &cmd));
+	CHECK(!parse("\"\"", &cmd));
+}
+
+#define ACTION_NAME(name, fn, first, middle) name,
+static const char * action_names[] = { MQTT_ACTION_LIST(ACTION_NAME) };
+
+static void test_action_find(void) {
+	for (int n = 0; n < MQTT_ACTION_NUM; n++) { // a mistyped hash letter leaves the action unreachable
+		mqtt_cmd_str_t action = { action_names[n], (uint16_t) strlen(action_names[n]) };
+		if (mqtt_action_find(&action) != n) {
+			printf("action %s not found\n", action_names[n]);
+			failures++;
+		}
+	}
+	mqtt_cmd_t cmd;
+	CHECK(parse("{\"action\": \"set_unlock_position\", \"unlock\": 20}", &cmd));
+	CHECK(mqtt_action_find(&cmd.action) == mqtt_action_set_unlock_position_id);
+	CHECK(parse("lockx", &cmd));
+	CHECK(mqtt_action_find(&cmd.action) < 0);
+	CHECK(parse("kcol", &cmd)); // same length and letters as "lock" in another order
+	CHECK(mqtt_action_find(&cmd.action) < 0);
+	mqtt_cmd_str_t empty = { "", 0 };
+	CHECK(mqtt_action_find(&empty) < 0);
+}
+
+int main(void) {
+	test_object();
+	test_key_order_and_whitespace();
+	test_unknown_and_nested_values();
+	test_position();
+	test_mac();
+	test_plain_payload();
+	test_not_terminated();
+	test_invalid();
+	test_action_find();
+	if (failures) {
+		printf("%d checks failed\n", failures);
+		return 1;
+	}
+	printf("all checks passed\n");
+	return 0;
+}
@@ -0,0 +1,126 @@
+/*
+ * Known-answer tests of uECC secp256r1, main/utils/uECC.c. Both sides of an ECDH agree even if the fixed-base comb or
+ * the field arithmetic is wrong, so the public keys and the shared secret are checked against published vectors:
+ * RFC 6979 A.2.5 for the key pair and the first NIST CAVS ECC CDH P-256 vector for ECDH. Every multiply backend must
+ * pass them, see CMakeLists.txt. The vectors are big endian, as taken by the _lit functions. uECC.h sets
+ * uECC_VLI_NATIVE_LITTLE_ENDIAN, so the other functions take each coordinate reversed.
+ */
+
+#include "uECC.h"
+#include "types.h"
+#include <stdio.h>
+#include <string.h>
+
+static int failures = 0;
+
+#define CHECK(cond)                                                         \
+	do {                                                                    \
+		if (!(cond)) {                                                      \
+			printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+			failures++;                                                     \
+		}                                                                   \
+	} while (0)
+
+typedef struct {
+	const char * d; // private key
+	const char * x; // public key
+	const char * y;
+} key_vector_t;
+
+static const key_vector_t key_vectors[] = {
+	{ // 1 * G, the first comb entry
+		"0000000000000000000000000000000000000000000000000000000000000001",
+		"6B17D1F2E12C4247F8BCE6E563A440F277037D812DEB33A0F4A13945D898C296",
+		"4FE342E2FE1A7F9B8EE7EB4A7C0F9E162BCE33576B315ECECBB6406837BF51F5",
+	},
+	{ // 2 * G
+		"0000000000000000000000000000000000000000000000000000000000000002",
+		"7CF27B188D034F7E8A52380304B51AC3C08969E277F21B35A60B48FC47669978",
+		"07775510DB8ED040293D9AC69F7430DBBA7DADE63CE982299E04B79D227873D1",
+	},
+	{ // (n - 1) * G = -G, every comb column is used
+		"FFFFFFFF00000000FFFFFFFFFFFFFFFFBCE6FAADA7179E84F3B9CAC2FC632550",
+		"6B17D1F2E12C4247F8BCE6E563A440F277037D812DEB33A0F4A13945D898C296",
+		"B01CBD1C01E58065711814B583F061E9D431CCA994CEA1313449BF97C840AE0A",
+	},
+	{ // RFC 6979 A.2.5
+		"C9AFA9D845BA75166B5C215767B1D6934E50C3DB36E89B127B8A622B120F6721",
+		"60FED4BA255A9D31C961EB74C6356D68C049B8923B61FA6CE669622E60F29FB6",
+		"7903FE1008B8BC99A41AE9E95628BC64F2F1B20C2D7E9F5177A3C294D4462299",
+	},
+	{ // NIST CAVS ECC CDH P-256 COUNT = 0, dIUT and QIUT
+		"7D7DC5F71EB29DDAF80D6214632EEAE03D9058AF1FB6D22ED80BADB62BC1A534",
+		"EAD218590119E8876B29146FF89CA61770C4EDBBF97D38CE385ED281D8A6B230",
+		"28AF61281FD35E2FA7002523ACC85A429CB06EE6648325389F59EDFCE1405141",
+	},
+};
+
+// NIST CAVS ECC CDH P-256 COUNT = 0, QCAVS and ZIUT. dIUT is the last key vector
+static const char * cdh_qx = "700C48F77F56584C5CC632CA65640DB91B6BACCE3A4DF6B42CE7CC838833D287";
+static const char * cdh_qy = "DB71E509E3FD9B060DDB20BA5C51DCC5948D46FBF640DFE0441782CAB85FA4AC";
+static const char * cdh_z = "46FC62106420FF012E54A434FBDD2D25CCC5852060561E68040DD7778997BD7B";
+
+static void hex_to_bytes(const char * hex, uint8_t * out, int len) {
+	for (int n = 0; n < len; n++) {
+		unsigned v;
+		sscanf(hex + 2 * n, "%2x", &v);
+		out[n] = (uint8_t) v;
+	}
+}
+
+static void hex_to_native(const char * hex, uint8_t * out, int len) { // little endian, for uECC_VLI_NATIVE_LITTLE_ENDIAN
+	for (int n = 0; n < len; n++) {
+		unsigned v;
+		sscanf(hex + 2 * n, "%2x", &v);
+		out[len - 1 - n] = (uint8_t) v;
+	}
+}
+
+static void test_public_key(void) {
+	uECC_Curve curve = uECC_secp256r1();
+	uECC_word_t priv[32 / sizeof(uECC_word_t)], pub[64 / sizeof(uECC_word_t)]; // the native functions cast to uECC_word_t *
+	uint8_t expected[64];
+	for (size_t n = 0; n < sizeof(key_vectors) / sizeof(key_vectors[0]); n++) {
+		hex_to_native(key_vectors[n].d, (uint8_t *) priv, 32);
+		hex_to_native(key_vectors[n].x, expected, 32);
+		hex_to_native(key_vectors[n].y, expected + 32, 32);
+		memset(pub, 0, sizeof(pub));
+		CHECK(uECC_compute_public_key((uint8_t *) priv, (uint8_t *) pub, curve));
+		if (memcmp(pub, expected, sizeof(pub)) != 0) {
+			printf("public key of %s is wrong\n", key_vectors[n].d);
+			failures++;
+		}
+		CHECK(uECC_valid_public_key(expected, curve));
+	}
+}
+
+static void test_shared_secret(void) {
+	uECC_Curve curve = uECC_secp256r1();
+	const key_vector_t * iut = &key_vectors[sizeof(key_vectors) / sizeof(key_vectors[0]) - 1];
+	uint8_t priv[32], pub[64], expected[32], secret[32];
+	hex_to_bytes(iut->d, priv, 32); // the registration path
+	hex_to_bytes(cdh_qx, pub, 32);
+	hex_to_bytes(cdh_qy, pub + 32, 32);
+	hex_to_bytes(cdh_z, expected, 32);
+	memset(secret, 0, sizeof(secret));
+	CHECK(uECC_shared_secret_lit(pub, priv, secret, curve));
+	CHECK(memcmp(secret, expected, 32) == 0);
+	hex_to_native(iut->d, priv, 32);
+	hex_to_native(cdh_qx, pub, 32);
+	hex_to_native(cdh_qy, pub + 32, 32);
+	hex_to_native(cdh_z, expected, 32);
+	memset(secret, 0, sizeof(secret));
+	CHECK(uECC_shared_secret(pub, priv, secret, curve));
+	CHECK(memcmp(secret, expected, 32) == 0);
+}
+
+int main(void) {
+	test_public_key();
+	test_shared_secret();
+	if (failures) {
+		printf("word %d square %d: %d checks failed\n", uECC_WORD_SIZE, uECC_SQUARE_FUNC, failures);
+		return 1;
+	}
+	printf("word %d square %d: all checks passed\n", uECC_WORD_SIZE, uECC_SQUARE_FUNC);
+	return 0;
+}
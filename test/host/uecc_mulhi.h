@@ -0,0 +1,8 @@
+/*
+ * Forced into uECC.c by the test_uecc_mulhi target. A C high-half multiply stands in for the mulhu of asm_riscv.inc
+ * and the muluh of asm_xtensa.inc, so the uECC_mulhi paths of muladd() and mul2add() run on the host.
+ */
+
+#include <stdint.h>
+
+#define uECC_mulhi(a, b) ((uint32_t) (((uint64_t) (a) * (b)) >> 32))